@@ -0,0 +1,50 @@
+#include <sargs.h>
+#include <chrono>
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+  SARGS_OPTIONAL_FLAG_VALUE_DEFAULT("--bytes", "-b", "Number of bytes in each value", "4096");
+  SARGS_OPTIONAL_FLAG_VALUE_DEFAULT("--iterations", "-i", "Number of decodes to time", "10000");
+  SARGS_INITIALIZE(argc, argv);
+
+  const size_t bytes = SARGS_GET_UINT64("--bytes");
+  const uint64_t iterations = SARGS_GET_UINT64("--iterations");
+
+  const char* hex_digits = "0123456789abcdef";
+  const char* base64_digits = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  string hex;
+  string base64;
+  for (size_t i = 0; i < bytes; ++i) {
+    hex += hex_digits[(i * 7) % 16];
+    hex += hex_digits[(i * 13) % 16];
+  }
+  for (size_t i = 0; i < bytes / 3 * 4; ++i)
+    base64 += base64_digits[(i * 29) % 64];
+
+  vector<uint8_t> out(bytes + 16);
+  size_t failures = 0;
+  const auto time = [&](const char* name, const string& text, size_t (*decode)(const char*, size_t, uint8_t*)) {
+    auto start = chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; ++i)
+      failures += decode(text.data(), text.size(), out.data()) != string::npos;
+    auto stop = chrono::steady_clock::now();
+    const double seconds = chrono::duration<double>(stop - start).count();
+    cout << name << ": " << text.size() * iterations / seconds / 1e6 << " MB/s of text" << endl;
+  };
+
+  cout << "bytes: " << bytes << ", simd: " << (SARGS_SIMD_SSE2 ? "sse2" : "none") << endl;
+  time("hex", hex, [](const char* text, size_t size, uint8_t* data) { return sargs::DecodeHex(text, size, data); });
+  time("hex scalar", hex, [](const char* text, size_t size, uint8_t* data) {
+    return sargs::DecodeHexScalar(text, size, data);
+  });
+  time("base64", base64, [](const char* text, size_t size, uint8_t* data) {
+    size_t written = 0;
+    return sargs::DecodeBase64(text, size, data, written);
+  });
+  time("base64 scalar", base64, [](const char* text, size_t size, uint8_t* data) {
+    size_t written = 0;
+    return sargs::DecodeBase64Scalar(text, size, data, written);
+  });
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,45 @@
+#include <sargs.h>
+#include <server_flags.h>
+#include <chrono>
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+  SARGS_OPTIONAL_FLAG_VALUE_DEFAULT("--iterations", "-i", "Number of parses to time", "100000");
+  SARGS_INITIALIZE(argc, argv);
+
+  const uint64_t iterations = SARGS_GET_UINT64("--iterations");
+
+  vector<string> storage = { "./server", "--host=example.com", "-p", "80", "--workers=8", "--mode=safe",
+                             "--features=tls,gzip", "-v", "file" };
+  vector<char*> server_argv;
+  for (auto& arg : storage)
+    server_argv.push_back(&arg.front());
+  const int server_argc = static_cast<int>(server_argv.size());
+
+  // Args are registered ahead of time, so only parsing and loading the struct is timed
+  vector<sargs::Args> schemas(iterations);
+  for (auto& args : schemas)
+    ServerFlags::Register(args);
+
+  size_t checksum = 0;
+  auto start = chrono::steady_clock::now();
+  for (auto& args : schemas) {
+    args.Initialize(server_argc, server_argv.data());
+    ServerFlags flags;
+    flags.Load(args);
+    checksum += flags.port + flags.workers;
+  }
+  auto loaded = chrono::steady_clock::now();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    ServerFlags flags;
+    flags.Parse(server_argc, server_argv.data());
+    checksum -= flags.port + flags.workers;
+  }
+  auto stop = chrono::steady_clock::now();
+
+  cout << "tokens: " << server_argc - 1 << endl;
+  cout << "args: " << chrono::duration<double, nano>(loaded - start).count() / iterations << " ns/parse" << endl;
+  cout << "generated: " << chrono::duration<double, nano>(stop - loaded).count() / iterations << " ns/parse" << endl;
+  return checksum == 0 ? 0 : 1;
+}
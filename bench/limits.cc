@@ -0,0 +1,58 @@
+#include <sargs.h>
+#include <chrono>
+
+using namespace std;
+
+// Times Initialize() on one hostile command line, returning microseconds per attempt
+static double Time(const sargs::ParseLimits& limits, vector<string>& storage, const uint64_t iterations,
+                   string& error) {
+  vector<char*> argv;
+  for (auto& arg : storage)
+    argv.push_back(&arg.front());
+
+  // A fresh instance per attempt, since values accumulate across initializations
+  vector<sargs::Args> instances(iterations);
+  for (auto& args : instances) {
+    args.DisableExit();
+    args.DisableUsage();
+    args.AddOptionalFlag("--verbose", "-v", "Verbose");
+    args.AddOptionalFlagValue("--level", "-l", "Level", "0");
+    args.AddOptionalFlagMap("--define", "-D", "Definitions");
+    args.SetLimits(limits);
+  }
+
+  auto start = chrono::steady_clock::now();
+  for (auto& args : instances)
+    args.Initialize(static_cast<int>(argv.size()), argv.data());
+  auto stop = chrono::steady_clock::now();
+  error = instances.back().GetError();
+  return chrono::duration<double, micro>(stop - start).count() / iterations;
+}
+
+int main(int argc, char* argv[]) {
+  SARGS_OPTIONAL_FLAG_VALUE_DEFAULT("--scale", "-s", "Size of each hostile input", "1000000");
+  SARGS_OPTIONAL_FLAG_VALUE_DEFAULT("--iterations", "-i", "Number of parses to time", "5");
+  SARGS_INITIALIZE(argc, argv);
+
+  const size_t scale = SARGS_GET_UINT64("--scale");
+  const uint64_t iterations = SARGS_GET_UINT64("--iterations");
+
+  vector<pair<string, vector<string>>> inputs;
+  inputs.emplace_back("many tokens", vector<string>(scale, "-v"));
+  inputs.emplace_back("long value", vector<string>{ "--level=" + string(scale, '9') });
+  inputs.emplace_back("long cluster", vector<string>{ "-" + string(scale, 'v') });
+  string entries;
+  for (size_t i = 0; i < scale / 8; ++i)
+    entries += "k=v,";
+  inputs.emplace_back("many map entries", vector<string>{ "--define=" + entries + "k=v" });
+
+  for (auto& input : inputs) {
+    input.second.insert(input.second.begin(), "program");
+    string error;
+    const double hardened = Time(sargs::ParseLimits::Hardened(), input.second, iterations, error);
+    cout << input.first << ": " << hardened << " us hardened (" << error << ")";
+    const double unlimited = Time(sargs::ParseLimits(), input.second, iterations, error);
+    cout << ", " << unlimited << " us unlimited" << endl;
+  }
+  return 0;
+}
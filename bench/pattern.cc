@@ -0,0 +1,44 @@
+#include <sargs.h>
+#include <chrono>
+#include <regex>
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+  SARGS_OPTIONAL_FLAG_VALUE_DEFAULT("--values", "-n", "Number of values to validate", "1000000");
+  SARGS_OPTIONAL_FLAG_VALUE_DEFAULT("--pattern", "-p", "Expression to validate with",
+                                    "[a-z0-9]([a-z0-9-]*[a-z0-9])?(\\.[a-z0-9]([a-z0-9-]*[a-z0-9])?)*");
+  SARGS_INITIALIZE(argc, argv);
+
+  const size_t count = SARGS_GET_UINT64("--values");
+  const string expression = SARGS_GET_STRING("--pattern");
+
+  // Host names, every tenth one invalid
+  vector<string> values;
+  for (size_t i = 0; i < count; ++i)
+    values.push_back("node-" + to_string(i) + (i % 10 == 0 ? "_bad" : "") + ".rack" + to_string(i % 97) +
+                     ".example.com");
+
+  auto start = chrono::steady_clock::now();
+  const sargs::Pattern pattern(expression);
+  auto compiled = chrono::steady_clock::now();
+  size_t dfa_matches = 0;
+  for (const auto& value : values)
+    dfa_matches += pattern.Matches(value);
+  auto stop = chrono::steady_clock::now();
+
+  const regex reference(expression);
+  auto regex_start = chrono::steady_clock::now();
+  size_t regex_matches = 0;
+  for (const auto& value : values)
+    regex_matches += regex_match(value, reference);
+  auto regex_stop = chrono::steady_clock::now();
+
+  cout << "values: " << count << ", dfa states: " << pattern.States() << endl;
+  cout << "compile: " << chrono::duration<double, micro>(compiled - start).count() << " us" << endl;
+  cout << "dfa: " << chrono::duration<double, nano>(stop - compiled).count() / count << " ns/value, "
+       << dfa_matches << " matched" << endl;
+  cout << "std::regex: " << chrono::duration<double, nano>(regex_stop - regex_start).count() / count
+       << " ns/value, " << regex_matches << " matched" << endl;
+  return dfa_matches == regex_matches ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+#include <sargs.h>
+#include <chrono>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#define PERF_TYPE_HARDWARE 0
+#define PERF_COUNT_HW_CACHE_MISSES 0
+#define PERF_COUNT_HW_CACHE_REFERENCES 0
+#endif
+
+using namespace std;
+
+// Counts hardware events around a block of code, like perf stat. Reports nothing when the kernel
+// or the sandbox doesn't allow perf events.
+class Counter {
+ public:
+  Counter(const uint32_t type, const uint64_t config) {
+#if defined(__linux__)
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    _fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+    (void) type;
+    (void) config;
+#endif
+  }
+
+  ~Counter() {
+#if defined(__linux__)
+    if (_fd >= 0)
+      close(_fd);
+#endif
+  }
+
+  bool Available() const {
+    return _fd >= 0;
+  }
+
+  void Start() {
+#if defined(__linux__)
+    if (_fd >= 0) {
+      ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  uint64_t Stop() {
+    uint64_t count = 0;
+#if defined(__linux__)
+    if (_fd >= 0) {
+      ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(_fd, &count, sizeof(count)) != sizeof(count))
+        count = 0;
+    }
+#endif
+    return count;
+  }
+
+ private:
+  int _fd = -1;
+};
+
+// Registers optional flags, every other one taking a value
+static void Register(sargs::Args& args, const size_t flags) {
+  args.DisableExit();
+  for (size_t i = 0; i < flags; ++i) {
+    const string flag("--option-" + to_string(i));
+    if (i % 2 == 0)
+      args.AddOptionalFlagValue(flag, "", "A value flag of a large schema", "0");
+    else
+      args.AddOptionalFlag(flag, "", "A boolean flag of a large schema");
+  }
+}
+
+int main(int argc, char* argv[]) {
+  SARGS_OPTIONAL_FLAG_VALUE_DEFAULT("--flags", "-f", "Number of flags in the schema", "4096");
+  SARGS_OPTIONAL_FLAG_VALUE_DEFAULT("--iterations", "-i", "Number of parses to time", "50");
+  SARGS_INITIALIZE(argc, argv);
+
+  const size_t flags = SARGS_GET_UINT64("--flags");
+  const uint64_t iterations = SARGS_GET_UINT64("--iterations");
+
+  // The command line sets the last flags, so every token is classified against the whole registry
+  vector<string> storage = { "program" };
+  for (size_t i = flags > 16 ? flags - 16 : 0; i < flags; ++i) {
+    storage.push_back("--option-" + to_string(i));
+    if (i % 2 == 0)
+      storage.push_back(to_string(i));
+  }
+
+  vector<char*> args_argv;
+  for (auto& arg : storage)
+    args_argv.push_back(&arg.front());
+
+  vector<sargs::Args> schemas(iterations);
+  for (auto& args : schemas)
+    Register(args, flags);
+
+  Counter cache_misses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+  Counter cache_references(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES);
+  cache_misses.Start();
+  cache_references.Start();
+  auto start = chrono::steady_clock::now();
+  for (auto& args : schemas)
+    args.Initialize(static_cast<int>(args_argv.size()), args_argv.data());
+  auto stop = chrono::steady_clock::now();
+  const uint64_t misses = cache_misses.Stop();
+  const uint64_t references = cache_references.Stop();
+
+  cout << "flags: " << flags << ", tokens: " << storage.size() - 1 << endl;
+  cout << "parse: " << chrono::duration<double, micro>(stop - start).count() / iterations
+       << " us/iteration" << endl;
+  if (cache_misses.Available() && cache_references.Available()) {
+    cout << "cache misses: " << misses / iterations << "/iteration of " << references / iterations
+         << " references" << endl;
+  } else {
+    cout << "cache misses: unavailable (perf events not permitted)" << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,64 @@
+#include <sargs.h>
+#include <sargs_static_flag.h>
+#include <chrono>
+
+using namespace std;
+
+SARGS_STATIC_FLAG(trace)
+
+static bool plain_trace = false;
+static uint64_t traced = 0;
+
+__attribute__((noinline)) static void Trace(const uint64_t i) {
+  traced += i;
+}
+
+__attribute__((noinline)) static uint64_t CheckPlain(const uint64_t iterations) {
+  uint64_t sum = 0;
+  for (uint64_t i = 0; i < iterations; ++i) {
+    sum += i;
+    if (plain_trace)
+      Trace(i);
+    // Keep the compiler from hoisting the load out of the loop, as it can't when the
+    // check lives in a function called from the loop
+    asm volatile("" : : : "memory");
+  }
+  return sum;
+}
+
+__attribute__((noinline)) static uint64_t CheckStatic(const uint64_t iterations) {
+  uint64_t sum = 0;
+  for (uint64_t i = 0; i < iterations; ++i) {
+    sum += i;
+    if (SARGS_STATIC_HAS(trace))
+      Trace(i);
+    asm volatile("" : : : "memory");
+  }
+  return sum;
+}
+
+template <typename Function>
+static double NanosPerCheck(Function function, const uint64_t iterations) {
+  auto start = chrono::steady_clock::now();
+  const uint64_t sum = function(iterations);
+  auto stop = chrono::steady_clock::now();
+  if (sum == 0)
+    cout << "";
+  return chrono::duration<double, nano>(stop - start).count() / iterations;
+}
+
+int main(int argc, char* argv[]) {
+  SARGS_OPTIONAL_STATIC_FLAG(trace, "--trace", "-t", "Call the trace function on every iteration");
+  SARGS_OPTIONAL_FLAG_VALUE_DEFAULT("--iterations", "-i", "Number of checks to time", "1000000000");
+  SARGS_INITIALIZE(argc, argv);
+
+  plain_trace = SARGS_HAS("--trace");
+  const uint64_t iterations = SARGS_GET_UINT64("--iterations");
+
+  const bool patched = sargs::static_flags::trace_key().Patched();
+  cout << "patched check sites: " << (patched ? "yes" : "no (plain bool checks)") << endl;
+  cout << "trace: " << (plain_trace ? "on" : "off") << endl;
+  cout << "plain bool:  " << NanosPerCheck(CheckPlain, iterations) << " ns/check" << endl;
+  cout << "static flag: " << NanosPerCheck(CheckStatic, iterations) << " ns/check" << endl;
+  return 0;
+}
@@ -0,0 +1,71 @@
+#include <sargs.h>
+#include <chrono>
+
+using namespace std;
+
+// Registers optional flags, every other one taking a value
+static void Register(sargs::Args& args, const size_t flags) {
+  args.DisableExit();
+  args.DisableUsage();
+  for (size_t i = 0; i < flags; ++i) {
+    const string flag("--option-" + to_string(i));
+    if (i % 2 == 0)
+      args.AddOptionalFlagValue(flag, "", "A value flag of a large schema", "0");
+    else
+      args.AddOptionalFlag(flag, "", "A boolean flag of a large schema");
+  }
+}
+
+// Times Initialize() on fresh instances, returning microseconds per parse
+static double Time(const size_t flags, const uint64_t iterations, vector<string>& storage, string& error) {
+  vector<char*> argv;
+  for (auto& arg : storage)
+    argv.push_back(&arg.front());
+
+  vector<sargs::Args> schemas(iterations);
+  for (auto& args : schemas)
+    Register(args, flags);
+
+  auto start = chrono::steady_clock::now();
+  for (auto& args : schemas)
+    args.Initialize(static_cast<int>(argv.size()), argv.data());
+  auto stop = chrono::steady_clock::now();
+  error = schemas.back().GetError();
+  return chrono::duration<double, micro>(stop - start).count() / iterations;
+}
+
+int main(int argc, char* argv[]) {
+  SARGS_OPTIONAL_FLAG_VALUE_DEFAULT("--flags", "-f", "Number of flags in the schema", "4096");
+  SARGS_OPTIONAL_FLAG_VALUE_DEFAULT("--iterations", "-i", "Number of parses to time", "50");
+  SARGS_INITIALIZE(argc, argv);
+
+  const size_t flags = SARGS_GET_UINT64("--flags");
+  const uint64_t iterations = SARGS_GET_UINT64("--iterations");
+
+  // The same command line of 16 flags, valid and with one misspelled flag
+  vector<string> valid = { "program" };
+  for (size_t i = flags > 16 ? flags - 16 : 0; i < flags; ++i)
+    valid.push_back("--option-" + to_string(i) + (i % 2 == 0 ? "=1" : ""));
+  vector<string> misspelled = valid;
+  misspelled.back().replace(2, 6, "optoin");
+
+  string error;
+  const double passed = Time(flags, iterations, valid, error);
+  const double failed = Time(flags, iterations, misspelled, error);
+
+  sargs::Args args;
+  Register(args, flags);
+  auto start = chrono::steady_clock::now();
+  size_t suggested = 0;
+  for (uint64_t i = 0; i < iterations; ++i)
+    suggested += args.Suggestions(misspelled.back()).size();
+  auto stop = chrono::steady_clock::now();
+  const double suggestions = chrono::duration<double, micro>(stop - start).count() / iterations;
+
+  cout << "flags: " << flags << ", tokens: " << valid.size() - 1 << endl;
+  cout << "valid parse: " << passed << " us/iteration" << endl;
+  cout << "failed parse: " << failed << " us/iteration" << endl;
+  cout << "suggestions alone: " << suggestions << " us/iteration, " << suggested / iterations << " found" << endl;
+  cout << error << endl;
+  return 0;
+}
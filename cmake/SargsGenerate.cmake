@@ -0,0 +1,26 @@
+#
+# sargs_generate (target schema [name])
+#
+# Generates <schema name>.h from a JSON flag schema, as written by --sargs-dump-schema, and adds
+# it to the target. The header defines a struct called name, Flags by default, with a field per
+# flag and a parser specialized for those flags. It is regenerated when the schema or the
+# generator changes.
+#
+function (sargs_generate target schema)
+  set (name Flags)
+  if (ARGC GREATER 2)
+    set (name ${ARGV2})
+  endif ()
+  get_filename_component (schema_path ${schema} ABSOLUTE)
+  get_filename_component (header ${schema} NAME_WE)
+  set (directory ${CMAKE_CURRENT_BINARY_DIR}/sargs_generated/${target})
+  set (output ${directory}/${header}.h)
+
+  file (MAKE_DIRECTORY ${directory})
+  add_custom_command (OUTPUT ${output}
+    COMMAND sargs-generate --schema=${schema_path} --output=${output} --name=${name}
+    DEPENDS sargs-generate ${schema_path}
+    COMMENT "Generating ${header}.h from ${schema}")
+  target_sources (${target} PRIVATE ${output})
+  target_include_directories (${target} PRIVATE ${directory})
+endfunction ()
@@ -3,9 +3,15 @@
 using namespace std;
 using namespace sargs;
 
+enum class Conversion {
+  kStandard,
+  kFast
+};
+
 int main(int argc, char* argv[]) {
   SARGS_OPTIONAL_FLAG_VALUE_DEFAULT("--display", "-d", "Displays", "1024x2048");
-  SARGS_OPTIONAL_FLAG_VALUE_DEFAULT("--convert", "-c", "Converts", "standard");
+  SARGS_OPTIONAL_FLAG_ENUM_DEFAULT("--convert", "-c", "Converts", "standard",
+                                   {"standard", Conversion::kStandard}, {"fast", Conversion::kFast});
   try { SARGS_INITIALIZE(argc, argv); }
   catch (SargsError& er) {
     cerr << "Sargs threw error" << endl;
@@ -13,7 +19,14 @@ int main(int argc, char* argv[]) {
   }
 
   cout << "Display is " << SARGS_GET_STRING("--display") << endl;
-  cout << "Convert is " << SARGS_GET_STRING("--convert") << endl;
+  switch (SARGS_GET_ENUM_AS(Conversion, "--convert")) {
+    case Conversion::kStandard:
+      cout << "Convert is standard" << endl;
+      break;
+    case Conversion::kFast:
+      cout << "Convert is fast" << endl;
+      break;
+  }
 
   return 0;
 }
@@ -5,19 +5,38 @@
 #pragma once
 
 #include <cerrno>
+#include <cstring>
 #include <cstdint>
 #include <cctype>
 #include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <functional>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 #include <limits>
 
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(SARGS_DISABLE_SIMD)
+#define SARGS_SIMD_SSE2 1
+#include <emmintrin.h>
+#else
+#define SARGS_SIMD_SSE2 0
+#endif
+
 namespace sargs {
 
 class SargsError : public std::runtime_error {
@@ -26,39 +45,1703 @@ class SargsError : public std::runtime_error {
   ~SargsError() = default;
 };
 
+// Seeded 64-bit FNV-1a with a final fold so the low bits are usable as a table index
+inline uint64_t HashBytes(const char* data, const size_t size, const uint64_t seed = 0) {
+  uint64_t hash = 14695981039346656037ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash ^ (hash >> 29);
+}
+
+// Approximate heap bytes held by a string, excluding storage inside the object
+inline size_t HeapBytes(const std::string& text) {
+  static const size_t inline_capacity = std::string().capacity();
+  return text.capacity() > inline_capacity ? text.capacity() + 1 : 0;
+}
+
+// A named value accepted by an enum or set flag
+struct Choice {
+  template <typename T>
+  Choice(const std::string& _name, const T _value) : name(_name), value(static_cast<int64_t>(_value)) {}
+
+  std::string name;
+  int64_t value = 0;
+};
+
+// Perfect-hash table over the choices of a flag. The seed and table size are
+// searched once at registration so every lookup is one hash and one compare.
+class ChoiceTable {
+ public:
+  ChoiceTable() = default;
+
+  explicit ChoiceTable(const std::vector<Choice>& choices) : _choices(choices) {
+    for (size_t i = 0; i < _choices.size(); ++i) {
+      for (size_t j = i + 1; j < _choices.size(); ++j) {
+        if (_choices[i].name == _choices[j].name)
+          throw SargsError("Duplicate choice " + _choices[i].name);
+      }
+    }
+
+    size_t size = 1;
+    while (size < _choices.size() * 2) size <<= 1;
+    for (;;) {
+      for (uint64_t seed = 0; seed < 64; ++seed) {
+        if (this->TryBuild(size, seed))
+          return;
+      }
+      size <<= 1;
+    }
+  }
+
+  bool Find(const std::string& name, int64_t& value) const {
+    if (_slots.empty())
+      return false;
+    const int32_t slot = _slots[HashBytes(name.data(), name.size(), _seed) & _mask];
+    if (slot < 0 || _choices[slot].name != name)
+      return false;
+    value = _choices[slot].value;
+    return true;
+  }
+
+  const std::vector<Choice>& Choices() const {
+    return _choices;
+  }
+
+  size_t MemoryUsage() const {
+    size_t bytes = _choices.capacity() * sizeof(Choice) + _slots.capacity() * sizeof(int32_t);
+    for (const auto& choice : _choices)
+      bytes += HeapBytes(choice.name);
+    return bytes;
+  }
+
+ private:
+  std::vector<Choice> _choices;
+  std::vector<int32_t> _slots;
+  uint64_t _seed = 0;
+  uint64_t _mask = 0;
+
+  bool TryBuild(const size_t size, const uint64_t seed) {
+    _slots.assign(size, -1);
+    for (size_t i = 0; i < _choices.size(); ++i) {
+      const size_t slot = HashBytes(_choices[i].name.data(), _choices[i].name.size(), seed) & (size - 1);
+      if (_slots[slot] >= 0)
+        return false;
+      _slots[slot] = static_cast<int32_t>(i);
+    }
+    _seed = seed;
+    _mask = size - 1;
+    return true;
+  }
+};
+
+inline bool ConvertToInt64(const std::string& text, int64_t& value) {
+  if (text.empty())
+    return false;
+  char* end = nullptr;
+  errno = 0;
+  value = std::strtoll(text.c_str(), &end, 0);
+  return *end == '\0' && errno != ERANGE;
+}
+
+inline bool ConvertToUInt64(const std::string& text, uint64_t& value) {
+  if (text.empty())
+    return false;
+  char* end = nullptr;
+  errno = 0;
+  value = std::strtoull(text.c_str(), &end, 0);
+  return *end == '\0' && errno != ERANGE;
+}
+
+inline bool ConvertToFloat(const std::string& text, float& value) {
+  if (text.empty())
+    return false;
+  char* end = nullptr;
+  errno = 0;
+  value = std::strtof(text.c_str(), &end);
+  return *end == '\0' && errno != ERANGE;
+}
+
+enum class ArgumentKind {
+  kPlain,
+  kEnum,  // Value must be one of the choices and decodes to its integer
+  kSet,   // Value is a comma separated list of choices and decodes to a bitmask
+  kSweep,  // Value is a range or list that expands into a dimension of the sweep
+  kMap,    // Every occurrence adds key=value or key:value entries, comma separated
+  kHex,    // Value is hex digits, optionally after 0x, and decodes to bytes
+  kBase64,  // Value is standard base64, padded or not, and decodes to bytes
+  kNumber   // Value is an integer or floating point number, compared by value in fingerprints
+};
+
+// Non-owning view of decoded bytes, standing in for C++20's std::span<const std::byte>
+struct ByteSpan {
+  ByteSpan() = default;
+
+  ByteSpan(const uint8_t* _data, const size_t _size) : data(_data), size(_size) {}
+
+  const uint8_t* begin() const {
+    return data;
+  }
+
+  const uint8_t* end() const {
+    return data + size;
+  }
+
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+};
+
+// Value of a hex digit, or 0xff
+inline uint8_t HexDigit(const char c) {
+  if (c >= '0' && c <= '9')
+    return static_cast<uint8_t>(c - '0');
+  if (c >= 'a' && c <= 'f')
+    return static_cast<uint8_t>(c - 'a' + 10);
+  if (c >= 'A' && c <= 'F')
+    return static_cast<uint8_t>(c - 'A' + 10);
+  return 0xff;
+}
+
+// Value of a base64 digit, or 0xff
+inline uint8_t Base64Digit(const char c) {
+  if (c >= 'A' && c <= 'Z')
+    return static_cast<uint8_t>(c - 'A');
+  if (c >= 'a' && c <= 'z')
+    return static_cast<uint8_t>(c - 'a' + 26);
+  if (c >= '0' && c <= '9')
+    return static_cast<uint8_t>(c - '0' + 52);
+  if (c == '+')
+    return 62;
+  if (c == '/')
+    return 63;
+  return 0xff;
+}
+
+// Decodes an even number of hex digits into size / 2 bytes. Returns the offset of the first
+// invalid digit, or std::string::npos
+inline size_t DecodeHexScalar(const char* text, const size_t size, uint8_t* out) {
+  for (size_t i = 0; i + 1 < size; i += 2) {
+    const uint8_t high = HexDigit(text[i]);
+    const uint8_t low = HexDigit(text[i + 1]);
+    if (high == 0xff || low == 0xff)
+      return (high == 0xff) ? i : i + 1;
+    out[i / 2] = static_cast<uint8_t>(high << 4 | low);
+  }
+  return std::string::npos;
+}
+
+// Decodes padded or unpadded base64 and sets written to the number of bytes. Returns the offset of
+// the first invalid character, or std::string::npos
+inline size_t DecodeBase64Scalar(const char* text, size_t size, uint8_t* out, size_t& written) {
+  written = 0;
+  size_t padding = 0;
+  if (size % 4 == 0) {
+    while (padding < 2 && size > 0 && text[size - 1] == '=') {
+      --size;
+      ++padding;
+    }
+  }
+  if (size % 4 == 1)
+    return size - 1;
+
+  uint32_t group = 0;
+  for (size_t i = 0; i < size; ++i) {
+    const uint8_t digit = Base64Digit(text[i]);
+    if (digit == 0xff)
+      return i;
+    group = group << 6 | digit;
+    if (i % 4 == 3) {
+      out[written++] = static_cast<uint8_t>(group >> 16);
+      out[written++] = static_cast<uint8_t>(group >> 8);
+      out[written++] = static_cast<uint8_t>(group);
+    }
+  }
+  if (size % 4 == 2) {
+    out[written++] = static_cast<uint8_t>(group >> 4);
+  } else if (size % 4 == 3) {
+    out[written++] = static_cast<uint8_t>(group >> 10);
+    out[written++] = static_cast<uint8_t>(group >> 2);
+  }
+  return std::string::npos;
+}
+
+#if SARGS_SIMD_SSE2
+// Nibble values of 16 hex digits, or false if any of them is not a hex digit
+inline bool HexNibbles(const __m128i text, __m128i& nibbles) {
+  const __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(text, _mm_set1_epi8('0' - 1)),
+                                         _mm_cmplt_epi8(text, _mm_set1_epi8('9' + 1)));
+  const __m128i lower = _mm_or_si128(text, _mm_set1_epi8(0x20));
+  const __m128i is_letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                          _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+  if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) != 0xffff)
+    return false;
+  nibbles = _mm_or_si128(_mm_and_si128(is_digit, _mm_sub_epi8(text, _mm_set1_epi8('0'))),
+                         _mm_and_si128(is_letter, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+  return true;
+}
+
+// Decodes 32 hex digits into 16 bytes
+inline bool DecodeHexBlock(const char* text, uint8_t* out) {
+  __m128i first;
+  __m128i second;
+  if (!HexNibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text)), first) ||
+      !HexNibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + 16)), second))
+    return false;
+
+  // Each 16 bit lane holds a high nibble in its low byte and a low nibble in its high byte
+  const __m128i mask = _mm_set1_epi16(0x00ff);
+  first = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(first, mask), 4), _mm_srli_epi16(first, 8));
+  second = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(second, mask), 4), _mm_srli_epi16(second, 8));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(first, second));
+  return true;
+}
+
+// Decodes 16 base64 digits into 12 bytes. Padding is left to the scalar decoder
+inline bool DecodeBase64Block(const char* text, uint8_t* out) {
+  const __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text));
+  const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(input, _mm_set1_epi8('A' - 1)),
+                                      _mm_cmplt_epi8(input, _mm_set1_epi8('Z' + 1)));
+  const __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(input, _mm_set1_epi8('a' - 1)),
+                                      _mm_cmplt_epi8(input, _mm_set1_epi8('z' + 1)));
+  const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(input, _mm_set1_epi8('0' - 1)),
+                                      _mm_cmplt_epi8(input, _mm_set1_epi8('9' + 1)));
+  const __m128i plus = _mm_cmpeq_epi8(input, _mm_set1_epi8('+'));
+  const __m128i slash = _mm_cmpeq_epi8(input, _mm_set1_epi8('/'));
+  const __m128i letter = _mm_or_si128(upper, lower);
+  const __m128i valid = _mm_or_si128(_mm_or_si128(letter, digit), _mm_or_si128(plus, slash));
+  if (_mm_movemask_epi8(valid) != 0xffff)
+    return false;
+
+  // Offsets from each character to its value, wrapping modulo 256
+  __m128i offset = _mm_and_si128(upper, _mm_set1_epi8(-'A'));
+  offset = _mm_or_si128(offset, _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));
+  offset = _mm_or_si128(offset, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+  offset = _mm_or_si128(offset, _mm_and_si128(plus, _mm_set1_epi8(62 - '+')));
+  offset = _mm_or_si128(offset, _mm_and_si128(slash, _mm_set1_epi8(63 - '/')));
+  const __m128i values = _mm_add_epi8(input, offset);
+
+  // Each 32 bit lane holds four 6 bit values, first in its low byte, and packs into 24 bits
+  const __m128i six = _mm_set1_epi32(0x3f);
+  __m128i packed = _mm_slli_epi32(_mm_and_si128(values, six), 18);
+  packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(values, 8), six), 12));
+  packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(values, 16), six), 6));
+  packed = _mm_or_si128(packed, _mm_srli_epi32(values, 24));
+  uint32_t groups[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(groups), packed);
+  for (size_t i = 0; i < 4; ++i) {
+    out[3 * i] = static_cast<uint8_t>(groups[i] >> 16);
+    out[3 * i + 1] = static_cast<uint8_t>(groups[i] >> 8);
+    out[3 * i + 2] = static_cast<uint8_t>(groups[i]);
+  }
+  return true;
+}
+#endif
+
+// Decodes hex with SSE2 where available, finishing and locating errors with the scalar decoder
+inline size_t DecodeHex(const char* text, const size_t size, uint8_t* out) {
+  size_t done = 0;
+#if SARGS_SIMD_SSE2
+  while (done + 32 <= size && DecodeHexBlock(text + done, out + done / 2))
+    done += 32;
+#endif
+  const size_t invalid = DecodeHexScalar(text + done, size - done, out + done / 2);
+  return (invalid == std::string::npos) ? invalid : done + invalid;
+}
+
+// Decodes base64 with SSE2 where available, finishing and locating errors with the scalar decoder
+inline size_t DecodeBase64(const char* text, const size_t size, uint8_t* out, size_t& written) {
+  size_t done = 0;
+#if SARGS_SIMD_SSE2
+  while (done + 16 <= size && DecodeBase64Block(text + done, out + done / 4 * 3))
+    done += 16;
+#endif
+  const size_t invalid = DecodeBase64Scalar(text + done, size - done, out + done / 4 * 3, written);
+  written += done / 4 * 3;
+  return (invalid == std::string::npos) ? invalid : done + invalid;
+}
+
+// Decoded bytes of a hex or base64 flag, aligned for any fundamental type
+class ByteBuffer {
+ public:
+  ByteSpan Bytes() const {
+    return ByteSpan(reinterpret_cast<const uint8_t*>(_words.data()), _size);
+  }
+
+  // Decodes text and returns the offset of the first invalid character, or std::string::npos
+  size_t Decode(const ArgumentKind kind, const std::string& text) {
+    if (kind == ArgumentKind::kHex) {
+      const size_t prefix = (text.size() >= 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) ? 2 : 0;
+      const size_t digits = text.size() - prefix;
+      uint8_t* out = this->Allocate(digits / 2);
+      if (digits % 2 != 0)
+        return text.size() - 1;
+      const size_t invalid = DecodeHex(text.data() + prefix, digits, out);
+      return (invalid == std::string::npos) ? invalid : prefix + invalid;
+    }
+
+    size_t written = 0;
+    uint8_t* out = this->Allocate(text.size() / 4 * 3 + 3);
+    const size_t invalid = DecodeBase64(text.data(), text.size(), out, written);
+    _size = written;
+    return invalid;
+  }
+
+  size_t MemoryUsage() const {
+    return _words.capacity() * sizeof(uint64_t);
+  }
+
+ private:
+  std::vector<uint64_t> _words;
+  size_t _size = 0;
+
+  uint8_t* Allocate(const size_t size) {
+    _words.assign(size / sizeof(uint64_t) + 1, 0);
+    _size = size;
+    return reinterpret_cast<uint8_t*>(_words.data());
+  }
+};
+
+// Non-owning view of characters, standing in for C++17's std::string_view
+struct StringRef {
+  StringRef() = default;
+
+  StringRef(const char* _data, const size_t _size) : data(_data), size(_size) {}
+
+  std::string ToString() const {
+    return std::string(data, size);
+  }
+
+  bool operator==(const std::string& other) const {
+    return size == other.size() && std::equal(data, data + size, other.data());
+  }
+
+  const char* data = nullptr;
+  size_t size = 0;
+};
+
+// Process-wide table of flag names. Each distinct name is stored once, gets a stable id and is never
+// freed, so every Args instance that registers it shares the same copy.
+class NameTable {
+ public:
+  static NameTable& Instance() {
+    static NameTable* table = new NameTable();
+    return *table;
+  }
+
+  const std::string* Intern(const std::string& text, uint32_t& id) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto iter = _ids.find(text);
+    if (iter == _ids.end())
+      iter = _ids.emplace(text, static_cast<uint32_t>(_ids.size())).first;
+    id = iter->second;
+    return &iter->first;
+  }
+
+  size_t Size() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _ids.size();
+  }
+
+  size_t MemoryUsage() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t bytes = _ids.bucket_count() * sizeof(void*);
+    for (const auto& iter : _ids)
+      bytes += sizeof(iter) + 2 * sizeof(void*) + HeapBytes(iter.first);
+    return bytes;
+  }
+
+ private:
+  NameTable() {
+    _ids.emplace(std::string(), 0);
+  }
+
+  mutable std::mutex _mutex;
+  std::unordered_map<std::string, uint32_t> _ids;
+};
+
+// Handle to an interned flag name. Copies are a pointer and an id, and equal names compare by identity.
+class Name {
+ public:
+  Name() : Name(std::string()) {}
+
+  Name(const std::string& text) : _text(NameTable::Instance().Intern(text, _id)) {}
+
+  Name(const char* text) : Name(std::string(text)) {}
+
+  const std::string& Text() const {
+    return *_text;
+  }
+
+  operator const std::string&() const {
+    return *_text;
+  }
+
+  StringRef View() const {
+    return StringRef(_text->data(), _text->size());
+  }
+
+  uint32_t Id() const {
+    return _id;
+  }
+
+  bool Empty() const {
+    return _text->empty();
+  }
+
+  bool operator==(const Name& other) const {
+    return _text == other._text;
+  }
+
+  bool operator!=(const Name& other) const {
+    return _text != other._text;
+  }
+
+ private:
+  uint32_t _id = 0;
+  const std::string* _text;
+};
+
+inline bool operator==(const Name& name, const std::string& text) {
+  return name.Text() == text;
+}
+
+inline bool operator==(const std::string& text, const Name& name) {
+  return name.Text() == text;
+}
+
+inline std::ostream& operator<<(std::ostream& output, const Name& name) {
+  return output << name.Text();
+}
+
+// Bytes used by one Args instance, by category. Names are shared by every instance in the process
+// and are not part of Total().
+struct MemoryReport {
+  size_t registry = 0;
+  size_t descriptions = 0;
+  size_t values = 0;
+  size_t usage = 0;
+  size_t names = 0;
+
+  size_t Total() const {
+    return registry + descriptions + values + usage;
+  }
+};
+
+// Open-addressing hash map decoded once from the entries of a map flag. Keys and values are views
+// into the single buffer the map owns, so lookups hash and compare without allocating.
+class FlatMap {
+ public:
+  FlatMap() = default;
+
+  // Decodes comma separated key=value or key:value entries. Later keys replace earlier ones
+  bool Decode(const std::string& entries, std::string& invalid) {
+    _buffer = entries;
+    _slots.clear();
+    _size = 0;
+
+    std::vector<Slot> decoded;
+    size_t start = 0;
+    while (start < _buffer.size()) {
+      size_t end = _buffer.find(',', start);
+      if (end == std::string::npos)
+        end = _buffer.size();
+      const size_t separator = _buffer.find_first_of("=:", start);
+      if (separator == start || separator >= end) {
+        invalid = _buffer.substr(start, end - start);
+        return false;
+      }
+
+      Slot slot;
+      slot.key = static_cast<uint32_t>(start);
+      slot.key_size = static_cast<uint32_t>(separator - start);
+      slot.value = static_cast<uint32_t>(separator + 1);
+      slot.value_size = static_cast<uint32_t>(end - separator - 1);
+      slot.used = true;
+      decoded.push_back(slot);
+      start = end + 1;
+    }
+
+    size_t capacity = 1;
+    while (capacity < decoded.size() * 2) capacity <<= 1;
+    _slots.assign(capacity, Slot());
+    for (const auto& slot : decoded) {
+      Slot& target = _slots[this->Probe(&_buffer[slot.key], slot.key_size)];
+      if (!target.used)
+        ++_size;
+      target = slot;
+    }
+    return true;
+  }
+
+  bool Find(const std::string& key, StringRef& value) const {
+    if (_slots.empty())
+      return false;
+    const Slot& slot = _slots[this->Probe(key.data(), key.size())];
+    if (!slot.used)
+      return false;
+    value = StringRef(&_buffer[slot.value], slot.value_size);
+    return true;
+  }
+
+  // Returns the value or an empty view if the key is missing
+  StringRef Get(const std::string& key) const {
+    StringRef value;
+    this->Find(key, value);
+    return value;
+  }
+
+  bool Has(const std::string& key) const {
+    StringRef value;
+    return this->Find(key, value);
+  }
+
+  size_t Size() const {
+    return _size;
+  }
+
+  size_t MemoryUsage() const {
+    return HeapBytes(_buffer) + _slots.capacity() * sizeof(Slot);
+  }
+
+  std::vector<std::pair<StringRef, StringRef>> Items() const {
+    std::vector<std::pair<StringRef, StringRef>> items;
+    for (const auto& slot : _slots) {
+      if (slot.used) {
+        items.emplace_back(StringRef(&_buffer[slot.key], slot.key_size),
+                           StringRef(&_buffer[slot.value], slot.value_size));
+      }
+    }
+    return items;
+  }
+
+ private:
+  struct Slot {
+    uint32_t key = 0;
+    uint32_t key_size = 0;
+    uint32_t value = 0;
+    uint32_t value_size = 0;
+    bool used = false;
+  };
+
+  std::string _buffer;
+  std::vector<Slot> _slots;
+  size_t _size = 0;
+
+  // Index of the slot holding key or of the empty slot where it belongs
+  size_t Probe(const char* key, const size_t size) const {
+    const size_t mask = _slots.size() - 1;
+    size_t index = HashBytes(key, size) & mask;
+    while (_slots[index].used &&
+           !(_slots[index].key_size == size && std::equal(key, key + size, &_buffer[_slots[index].key])))
+      index = (index + 1) & mask;
+    return index;
+  }
+};
+
+// A lazily expanded cartesian product over the values of every sweep flag. The
+// first registered flag varies slowest. Points are computed from their index and
+// arithmetic ranges from their bounds, so a sweep of any size costs only its lists.
+class Sweep {
+ public:
+  // Most values of one range that are matched against a pattern
+  static const size_t kMaxPatternValues = 1 << 20;
+
+  // Values of one sweep flag. Lists and multiplying ranges, which have at most 64 values, are
+  // kept as strings. Arithmetic ranges compute the value at an index.
+  struct Dimension {
+    std::string flag;
+    std::string alias;
+    std::vector<std::string> values;
+    int64_t begin = 0;
+    int64_t step = 1;
+    size_t size = 0;
+
+    size_t Size() const {
+      return size;
+    }
+
+    std::string Value(const size_t index) const {
+      if (!values.empty())
+        return values[index];
+      const uint64_t value = static_cast<uint64_t>(begin) + index * static_cast<uint64_t>(step);
+      return std::to_string(static_cast<int64_t>(value));
+    }
+  };
+
+  class Point {
+   public:
+    Point(const Sweep* sweep, const size_t index) : _sweep(sweep), _index(index) {}
+
+    // Index of the point within the whole, unsharded sweep
+    size_t Index() const {
+      return _index;
+    }
+
+    bool GetAsString(const std::string& flag, std::string& value) const {
+      for (size_t i = 0; i < _sweep->_dimensions.size(); ++i) {
+        const Dimension& dimension = _sweep->_dimensions[i];
+        if (flag.empty() || (flag != dimension.flag && flag != dimension.alias))
+          continue;
+        value = dimension.Value((_index / _sweep->_strides[i]) % dimension.Size());
+        return true;
+      }
+      return false;
+    }
+    std::string GetAsString(const std::string& flag) const {
+      std::string value;
+      if (!this->GetAsString(flag, value))
+        throw SargsError(flag + " is not a sweep flag");
+      return value;
+    }
+
+    int64_t GetAsInt64(const std::string& flag) const {
+      const std::string value(this->GetAsString(flag));
+      int64_t myvalue = 0;
+      if (!ConvertToInt64(value, myvalue))
+        throw SargsError("Could not convert " + value + " to int64_t");
+      return myvalue;
+    }
+
+    float GetAsFloat(const std::string& flag) const {
+      const std::string value(this->GetAsString(flag));
+      float myvalue = 0.0;
+      if (!ConvertToFloat(value, myvalue))
+        throw SargsError("Could not convert " + value + " to float");
+      return myvalue;
+    }
+
+   private:
+    const Sweep* _sweep;
+    size_t _index;
+  };
+
+  class Iterator {
+   public:
+    Iterator(const Sweep* sweep, const size_t position) : _sweep(sweep), _position(position) {}
+
+    Point operator*() const {
+      return _sweep->At(_position);
+    }
+
+    Iterator& operator++() {
+      ++_position;
+      return *this;
+    }
+
+    bool operator!=(const Iterator& other) const {
+      return _position != other._position;
+    }
+
+   private:
+    const Sweep* _sweep;
+    size_t _position;
+  };
+
+  Sweep() = default;
+
+  // Adds a list of values as the fastest varying dimension
+  bool AddDimension(const std::string& flag, const std::string& alias, const std::vector<std::string>& values) {
+    Dimension dimension;
+    dimension.flag = flag;
+    dimension.alias = alias;
+    dimension.values = values;
+    dimension.size = values.size();
+    return this->AddDimension(dimension);
+  }
+
+  // Adds the fastest varying dimension. Returns false, leaving the sweep unchanged, if the
+  // dimension is empty or the number of points would overflow size_t.
+  bool AddDimension(const Dimension& dimension) {
+    if (dimension.Size() == 0 || _total > std::numeric_limits<size_t>::max() / dimension.Size())
+      return false;
+    for (auto& stride : _strides)
+      stride *= dimension.Size();
+    _dimensions.push_back(dimension);
+    _strides.push_back(1);
+    _total *= dimension.Size();
+    _count = _total;
+    _first = 0;
+    _step = 1;
+    return true;
+  }
+
+  const std::vector<Dimension>& Dimensions() const {
+    return _dimensions;
+  }
+
+  // Number of points in this sweep or shard
+  size_t Size() const {
+    return _count;
+  }
+
+  Point At(const size_t position) const {
+    return Point(this, _first + position * _step);
+  }
+
+  // Restricts the sweep to every shards-th point starting at shard, so N
+  // processes given shard 0..N-1 cover the whole sweep without overlap
+  Sweep Shard(const size_t shard, const size_t shards) const {
+    if (shards == 0 || shard >= shards)
+      throw SargsError("Invalid sweep shard " + std::to_string(shard) + " of " + std::to_string(shards));
+
+    Sweep sharded(*this);
+    sharded._first = _first + shard * _step;
+    sharded._step = _step * shards;
+    sharded._count = (_count > shard) ? (_count - shard + shards - 1) / shards : 0;
+    return sharded;
+  }
+
+  Iterator begin() const {
+    return Iterator(this, 0);
+  }
+
+  Iterator end() const {
+    return Iterator(this, _count);
+  }
+
+  // Expands start:end, start:end:step, start:end:xfactor, {a,b,c} or a single value. Returns
+  // false if the spec is invalid.
+  static bool Expand(const std::string& spec, std::vector<std::string>& values) {
+    values.clear();
+    Dimension dimension;
+    if (!Parse(spec, dimension))
+      return false;
+    for (size_t i = 0; i < dimension.Size(); ++i)
+      values.push_back(dimension.Value(i));
+    return true;
+  }
+
+  // Parses the spec of one dimension without expanding arithmetic ranges. Returns false if it is
+  // invalid or has more values than fit in size_t.
+  static bool Parse(const std::string& spec, Dimension& dimension) {
+    dimension.values.clear();
+    if (spec.size() >= 2 && spec.front() == '{' && spec.back() == '}') {
+      size_t start = 1;
+      while (start < spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos)
+          end = spec.size() - 1;
+        if (end == start)
+          return false;
+        dimension.values.push_back(spec.substr(start, end - start));
+        start = end + 1;
+      }
+      dimension.size = dimension.values.size();
+      return !dimension.values.empty();
+    }
+
+    const size_t first = spec.find(':');
+    if (first == std::string::npos) {
+      dimension.values.push_back(spec);
+      dimension.size = 1;
+      return !spec.empty();
+    }
+
+    const size_t second = spec.find(':', first + 1);
+    int64_t begin = 0;
+    int64_t end = 0;
+    int64_t step = 1;
+    bool multiply = false;
+    if (!ConvertToInt64(spec.substr(0, first), begin))
+      return false;
+    const size_t end_size = (second == std::string::npos) ? std::string::npos : second - first - 1;
+    if (!ConvertToInt64(spec.substr(first + 1, end_size), end))
+      return false;
+    if (second != std::string::npos) {
+      std::string step_str(spec.substr(second + 1));
+      if (!step_str.empty() && step_str[0] == 'x') {
+        multiply = true;
+        step_str.erase(0, 1);
+      } else if (!step_str.empty() && step_str[0] == '+') {
+        step_str.erase(0, 1);
+      }
+      if (!ConvertToInt64(step_str, step))
+        return false;
+    }
+
+    if (begin > end || (multiply && (step < 2 || begin <= 0)) || (!multiply && step <= 0))
+      return false;
+
+    if (multiply) {
+      for (int64_t value = begin;; value *= step) {
+        dimension.values.push_back(std::to_string(value));
+        if (value > end / step)
+          break;
+      }
+      dimension.size = dimension.values.size();
+      return true;
+    }
+
+    const uint64_t span = static_cast<uint64_t>(end) - static_cast<uint64_t>(begin);
+    const uint64_t steps = span / static_cast<uint64_t>(step);
+    if (steps >= std::numeric_limits<size_t>::max())
+      return false;
+    dimension.begin = begin;
+    dimension.step = step;
+    dimension.size = static_cast<size_t>(steps) + 1;
+    return true;
+  }
+
+ private:
+  std::vector<Dimension> _dimensions;
+  std::vector<size_t> _strides;
+  size_t _total = 1;
+  size_t _count = 1;
+  size_t _first = 0;
+  size_t _step = 1;
+};
+
+// Restricted regular expression compiled into a table driven DFA, for validating flag values in a
+// single pass without backtracking. The whole value must match. Supports literals, '.', classes
+// like [a-z_] and [^,], the escapes \d \w \s and \ before punctuation, groups, '|', '*', '+', '?'
+// and {n}, {n,} or {n,m}. Throws SargsError when the expression is invalid or too complex.
+class Pattern {
+ public:
+  explicit Pattern(const std::string& expression) : _expression(expression) {
+    Parser parser(expression, _sets);
+    const Node root = parser.Parse();
+    Nfa nfa;
+    nfa.states.resize(1);
+    const int end = nfa.Build(root, 0);
+    nfa.states[end].accept = true;
+    this->Compile(nfa);
+  }
+
+  const std::string& Expression() const {
+    return _expression;
+  }
+
+  bool Matches(const char* data, const size_t size) const {
+    uint32_t state = 1;
+    for (size_t i = 0; i < size && state != 0; ++i)
+      state = _table[state * _class_count + _classes[static_cast<uint8_t>(data[i])]];
+    return _accepting[state] != 0;
+  }
+
+  bool Matches(const std::string& value) const {
+    return this->Matches(value.data(), value.size());
+  }
+
+  size_t States() const {
+    return _accepting.size() - 1;
+  }
+
+  size_t MemoryUsage() const {
+    return HeapBytes(_expression) + _table.capacity() * sizeof(uint16_t) + _accepting.capacity();
+  }
+
+ private:
+  static const size_t kMaxRepeat = 255;
+  static const size_t kMaxNfaStates = 16384;
+  static const size_t kMaxDfaStates = 4096;
+
+  typedef std::bitset<256> ByteSet;
+
+  struct Node {
+    enum class Type { kEmpty, kBytes, kConcat, kAlternate, kRepeat };
+    Type type = Type::kEmpty;
+    size_t set = 0;                  // kBytes: index into the byte sets
+    size_t min = 0;                  // kRepeat
+    size_t max = 0;                  // kRepeat, kMaxRepeat + 1 for unbounded
+    std::vector<Node> children;
+  };
+
+  // Recursive descent over the expression, producing a syntax tree
+  class Parser {
+   public:
+    Parser(const std::string& expression, std::vector<ByteSet>& sets) : _text(expression), _sets(sets) {
+      if (!_text.empty() && _text[0] == '^')
+        _position = 1;
+      const bool escaped = _text.size() >= 2 && _text[_text.size() - 2] == '\\';
+      if (_text.size() > _position && _text.back() == '$' && !escaped)
+        _end = _text.size() - 1;
+      else
+        _end = _text.size();
+    }
+
+    Node Parse() {
+      Node node = this->Alternation();
+      if (_position != _end)
+        this->Fail("Unexpected )");
+      return node;
+    }
+
+   private:
+    const std::string& _text;
+    std::vector<ByteSet>& _sets;
+    size_t _position = 0;
+    size_t _end = 0;
+
+    [[noreturn]] void Fail(const std::string& message) const {
+      throw SargsError("Invalid pattern " + _text + " at offset " + std::to_string(_position) + ": " + message);
+    }
+
+    bool More() const {
+      return _position < _end;
+    }
+
+    Node Alternation() {
+      Node first = this->Concatenation();
+      if (!this->More() || _text[_position] != '|')
+        return first;
+      Node node;
+      node.type = Node::Type::kAlternate;
+      node.children.push_back(first);
+      while (this->More() && _text[_position] == '|') {
+        ++_position;
+        node.children.push_back(this->Concatenation());
+      }
+      return node;
+    }
+
+    Node Concatenation() {
+      Node node;
+      node.type = Node::Type::kConcat;
+      while (this->More() && _text[_position] != '|' && _text[_position] != ')')
+        node.children.push_back(this->Repetition());
+      return node;
+    }
+
+    Node Repetition() {
+      Node atom = this->Atom();
+      while (this->More()) {
+        size_t min = 0;
+        size_t max = 0;
+        const char c = _text[_position];
+        if (c == '*' || c == '+' || c == '?') {
+          min = (c == '+') ? 1 : 0;
+          max = (c == '?') ? 1 : kMaxRepeat + 1;
+          ++_position;
+        } else if (c == '{') {
+          ++_position;
+          min = this->Count();
+          max = min;
+          if (this->More() && _text[_position] == ',') {
+            ++_position;
+            max = (this->More() && _text[_position] == '}') ? kMaxRepeat + 1 : this->Count();
+          }
+          if (!this->More() || _text[_position] != '}' || max < min)
+            this->Fail("Invalid repetition");
+          ++_position;
+        } else {
+          break;
+        }
+        Node node;
+        node.type = Node::Type::kRepeat;
+        node.min = min;
+        node.max = max;
+        node.children.push_back(atom);
+        atom = node;
+      }
+      return atom;
+    }
+
+    size_t Count() {
+      size_t count = 0;
+      const size_t start = _position;
+      while (this->More() && std::isdigit(static_cast<unsigned char>(_text[_position])) && count <= kMaxRepeat)
+        count = count * 10 + static_cast<size_t>(_text[_position++] - '0');
+      if (_position == start || count > kMaxRepeat)
+        this->Fail("Repetition counts must be at most " + std::to_string(kMaxRepeat));
+      return count;
+    }
+
+    Node Atom() {
+      const char c = _text[_position];
+      if (c == '(') {
+        ++_position;
+        Node node = this->Alternation();
+        if (!this->More() || _text[_position] != ')')
+          this->Fail("Missing )");
+        ++_position;
+        return node;
+      }
+      if (c == '*' || c == '+' || c == '?' || c == '{')
+        this->Fail("Nothing to repeat");
+
+      ByteSet set;
+      if (c == '[') {
+        set = this->Class();
+      } else if (c == '.') {
+        set.set();
+        ++_position;
+      } else if (c == '\\') {
+        set = this->Escape();
+      } else {
+        set.set(static_cast<uint8_t>(c));
+        ++_position;
+      }
+      return this->Bytes(set);
+    }
+
+    Node Bytes(const ByteSet& set) {
+      Node node;
+      node.type = Node::Type::kBytes;
+      node.set = _sets.size();
+      _sets.push_back(set);
+      return node;
+    }
+
+    // Reads \d, \w, \s or an escaped character, leaving the position after it
+    ByteSet Escape() {
+      if (_position + 1 >= _end)
+        this->Fail("Trailing \\");
+      const char c = _text[_position + 1];
+      _position += 2;
+      ByteSet set;
+      for (int byte = 0; byte < 256; ++byte) {
+        if ((c == 'd' && std::isdigit(byte)) || (c == 'w' && (std::isalnum(byte) || byte == '_')) ||
+            (c == 's' && std::isspace(byte)))
+          set.set(byte);
+      }
+      if (c != 'd' && c != 'w' && c != 's') {
+        if (std::isalnum(static_cast<unsigned char>(c)))
+          this->Fail(std::string("Unsupported escape \\") + c);
+        set.set(static_cast<uint8_t>(c));
+      }
+      return set;
+    }
+
+    ByteSet Class() {
+      ++_position;
+      const bool negate = this->More() && _text[_position] == '^';
+      if (negate)
+        ++_position;
+      ByteSet set;
+      bool first = true;
+      while (this->More() && (_text[_position] != ']' || first)) {
+        first = false;
+        if (_text[_position] == '\\') {
+          const ByteSet escaped = this->Escape();
+          set |= escaped;
+          continue;
+        }
+        const uint8_t low = static_cast<uint8_t>(_text[_position++]);
+        uint8_t high = low;
+        if (_position + 1 < _end && _text[_position] == '-' && _text[_position + 1] != ']') {
+          high = static_cast<uint8_t>(_text[_position + 1]);
+          _position += 2;
+          if (high < low)
+            this->Fail("Invalid range");
+        }
+        for (int byte = low; byte <= high; ++byte)
+          set.set(byte);
+      }
+      if (!this->More())
+        this->Fail("Missing ]");
+      ++_position;
+      return negate ? ~set : set;
+    }
+  };
+
+  // Thompson construction: each state has epsilon edges and at most one byte transition
+  struct Nfa {
+    struct State {
+      std::vector<int> epsilon;
+      int set = -1;
+      int target = -1;
+      bool accept = false;
+    };
+    std::vector<State> states;
+
+    int Add() {
+      if (states.size() >= kMaxNfaStates)
+        throw SargsError("Pattern is too complex");
+      states.emplace_back();
+      return static_cast<int>(states.size()) - 1;
+    }
+
+    // Appends the node after state from and returns the state where it ends
+    int Build(const Node& node, const int from) {
+      switch (node.type) {
+        case Node::Type::kEmpty:
+          return from;
+        case Node::Type::kBytes: {
+          const int start = this->Add();
+          const int end = this->Add();
+          states[from].epsilon.push_back(start);
+          states[start].set = static_cast<int>(node.set);
+          states[start].target = end;
+          return end;
+        }
+        case Node::Type::kConcat: {
+          int end = from;
+          for (const auto& child : node.children)
+            end = this->Build(child, end);
+          return end;
+        }
+        case Node::Type::kAlternate: {
+          const int end = this->Add();
+          for (const auto& child : node.children) {
+            const int start = this->Add();
+            states[from].epsilon.push_back(start);
+            states[this->Build(child, start)].epsilon.push_back(end);
+          }
+          return end;
+        }
+        case Node::Type::kRepeat: {
+          int current = from;
+          for (size_t i = 0; i < node.min; ++i)
+            current = this->Build(node.children[0], current);
+          if (node.max > kMaxRepeat) {
+            const int loop = this->Add();
+            states[current].epsilon.push_back(loop);
+            states[this->Build(node.children[0], loop)].epsilon.push_back(loop);
+            return loop;
+          }
+          const int end = this->Add();
+          states[current].epsilon.push_back(end);
+          for (size_t i = node.min; i < node.max; ++i) {
+            current = this->Build(node.children[0], current);
+            states[current].epsilon.push_back(end);
+          }
+          return end;
+        }
+      }
+      return from;
+    }
+
+    void Close(std::vector<int>& set) const {
+      std::vector<bool> seen(states.size(), false);
+      for (int state : set)
+        seen[state] = true;
+      for (size_t i = 0; i < set.size(); ++i) {
+        for (int next : states[set[i]].epsilon) {
+          if (!seen[next]) {
+            seen[next] = true;
+            set.push_back(next);
+          }
+        }
+      }
+      std::sort(set.begin(), set.end());
+    }
+  };
+
+  std::string _expression;
+  std::vector<ByteSet> _sets;
+  uint8_t _classes[256] = {};  // Bytes that no set tells apart share a class
+  size_t _class_count = 0;
+  std::vector<uint16_t> _table;  // State * _class_count + class, state 0 rejects
+  std::vector<uint8_t> _accepting;
+
+  // Subset construction over byte classes
+  void Compile(const Nfa& nfa) {
+    std::map<std::vector<bool>, uint8_t> signatures;
+    std::vector<uint8_t> representative;
+    for (int byte = 0; byte < 256; ++byte) {
+      std::vector<bool> signature(_sets.size());
+      for (size_t i = 0; i < _sets.size(); ++i)
+        signature[i] = _sets[i].test(byte);
+      auto iter = signatures.find(signature);
+      if (iter == signatures.end()) {
+        iter = signatures.emplace(signature, static_cast<uint8_t>(representative.size())).first;
+        representative.push_back(static_cast<uint8_t>(byte));
+      }
+      _classes[byte] = iter->second;
+    }
+    _class_count = representative.size();
+
+    std::map<std::vector<int>, uint16_t> ids;
+    std::vector<std::vector<int>> subsets(1);
+    std::vector<int> start = { 0 };
+    nfa.Close(start);
+    ids[start] = 1;
+    subsets.push_back(start);
+    _table.assign(2 * _class_count, 0);
+    _accepting.assign(2, 0);
+    for (size_t id = 1; id < subsets.size(); ++id) {
+      for (int state : subsets[id]) {
+        if (nfa.states[state].accept)
+          _accepting[id] = 1;
+      }
+      for (size_t byte_class = 0; byte_class < _class_count; ++byte_class) {
+        std::vector<int> next;
+        for (int state : subsets[id]) {
+          const Nfa::State& from = nfa.states[state];
+          if (from.set >= 0 && _sets[from.set].test(representative[byte_class]))
+            next.push_back(from.target);
+        }
+        if (next.empty())
+          continue;
+        nfa.Close(next);
+        auto iter = ids.find(next);
+        if (iter == ids.end()) {
+          if (subsets.size() > kMaxDfaStates)
+            throw SargsError("Pattern " + _expression + " is too complex");
+          iter = ids.emplace(next, static_cast<uint16_t>(subsets.size())).first;
+          subsets.push_back(next);
+          _table.resize(subsets.size() * _class_count, 0);
+          _accepting.push_back(0);
+        }
+        _table[id * _class_count + byte_class] = iter->second;
+      }
+    }
+    std::vector<ByteSet>().swap(_sets);
+  }
+};
+
+// Description given at registration. Text marked with SARGS_LITERAL() is referenced where it is,
+// anything else is copied into the instance's packed description buffer.
+class DescriptionText {
+ public:
+  DescriptionText(const std::string& text) : _data(text.data()), _size(text.size()) {}
+
+  DescriptionText(const char* text) : _data(text), _size(std::strlen(text)) {}
+
+  // The text must live as long as the instance, as string literals do
+  static DescriptionText Literal(const char* text, const size_t size) {
+    DescriptionText literal(text, size);
+    literal._literal = true;
+    return literal;
+  }
+
+  const char* Data() const {
+    return _data;
+  }
+
+  size_t Size() const {
+    return _size;
+  }
+
+  bool IsLiteral() const {
+    return _literal;
+  }
+
+ private:
+  DescriptionText(const char* text, const size_t size) : _data(text), _size(size) {}
+
+  const char* _data;
+  size_t _size;
+  bool _literal = false;
+};
+
 struct Argument {
   Argument(const std::string& _flag,
            const std::string& _alias,
-           const std::string& _description,
            const bool _value) :
-    flag(_flag), alias(_alias), description(_description), value(_value) {}
+    flag(_flag), alias(_alias), value(_value) {}
 
   Argument(const std::string& _flag,
            const std::string& _alias,
-           const std::string& _description,
            const bool _value,
            const std::string& _fallback) :
-    flag(_flag), alias(_alias), description(_description), fallback(_fallback), value(_value) {}
+    flag(_flag), alias(_alias), fallback(_fallback), value(_value) {}
 
-  std::string flag;
-  std::string alias;
-  std::string description;
+  Argument(const std::string& _flag,
+           const std::string& _alias,
+           const std::string& _fallback,
+           const ArgumentKind _kind,
+           const std::vector<Choice>& _choices) :
+    flag(_flag), alias(_alias), fallback(_fallback), value(true), kind(_kind), choices(_choices) {}
+
+  Name flag;
+  Name alias;
+  const char* description_literal = nullptr;  // Set for literals, else the description is packed in Args
+  uint32_t description_offset = 0;
+  uint32_t description_size = 0;
+  uint32_t group = 0;  // Index into the groups of Args, 0 for none
   std::string fallback;
   bool value = false;
+  ArgumentKind kind = ArgumentKind::kPlain;
+  ChoiceTable choices;
+  std::shared_ptr<const Pattern> pattern;  // Constraint on each value, shared by copies of Args
+};
+
+// FNV-1a usable in constant expressions so string literal flags can select a template
+constexpr uint64_t HashFlag(const char* flag, const uint64_t hash = 14695981039346656037ULL) {
+  return *flag ? HashFlag(flag + 1, (hash ^ static_cast<uint8_t>(*flag)) * 1099511628211ULL) : hash;
+}
+
+// Flags pinned at build time with SARGS_PIN() or SARGS_PIN_INT() specialize this template
+template <uint64_t Hash>
+struct PinnedFlag {
+  static constexpr bool Pinned() { return false; }
+  static constexpr bool Present() { return false; }
+  static constexpr int64_t Value() { return 0; }
+};
+
+// View of the flags in one namespace, e.g. --db.pool_size and --db.timeout for "db". The values are
+// resolved once when the view is created, so reads use the short name without building the full
+// flag or searching every flag. Create it after initialization.
+class ArgsScope {
+ public:
+  ArgsScope() = default;
+
+  ArgsScope(const std::string& name, const std::vector<std::string>& names,
+            const std::map<std::string, std::string>& values) :
+    _name(name), _names(names), _values(values) {}
+
+  const std::string& Name() const {
+    return _name;
+  }
+
+  // Registered flags of the namespace without the prefix, e.g. pool_size
+  const std::vector<std::string>& Names() const {
+    return _names;
+  }
+
+  bool Has(const std::string& name) const {
+    return _values.find(name) != _values.end();
+  }
+
+  bool GetAsString(const std::string& name, std::string& value) const {
+    auto iter = _values.find(name);
+    if (iter == _values.end())
+      return false;
+    value = iter->second;
+    return true;
+  }
+
+  std::string GetAsString(const std::string& name) const {
+    std::string value;
+    if (!this->GetAsString(name, value))
+      return "";
+    return value;
+  }
+
+  int64_t GetAsInt64(const std::string& name) const {
+    int64_t value = 0;
+    if (!ConvertToInt64(this->Require(name), value))
+      throw SargsError("Could not convert " + this->Flag(name) + " to int64_t");
+    return value;
+  }
+
+  uint64_t GetAsUInt64(const std::string& name) const {
+    uint64_t value = 0;
+    if (!ConvertToUInt64(this->Require(name), value))
+      throw SargsError("Could not convert " + this->Flag(name) + " to uint64_t");
+    return value;
+  }
+
+  float GetAsFloat(const std::string& name) const {
+    float value = 0.0;
+    if (!ConvertToFloat(this->Require(name), value))
+      throw SargsError("Could not convert " + this->Flag(name) + " to float");
+    return value;
+  }
+
+ private:
+  std::string _name;
+  std::vector<std::string> _names;
+  std::map<std::string, std::string> _values;
+
+  std::string Flag(const std::string& name) const {
+    return "--" + _name + "." + name;
+  }
+
+  const std::string& Require(const std::string& name) const {
+    auto iter = _values.find(name);
+    if (iter == _values.end())
+      throw SargsError(this->Flag(name) + " was not specified");
+    return iter->second;
+  }
 };
 
+// Levenshtein distance from one pattern of up to 64 bytes to any number of texts, with Myers'
+// bit-parallel algorithm: a column of the distance matrix is one word, so each text byte costs a
+// few word operations regardless of the pattern length
+class EditDistance {
+ public:
+  explicit EditDistance(const std::string& pattern) : _size(pattern.size()) {
+    if (!this->Valid())
+      return;
+    for (size_t i = 0; i < _size; ++i)
+      _peq[static_cast<uint8_t>(pattern[i])] |= uint64_t(1) << i;
+  }
+
+  bool Valid() const {
+    return _size > 0 && _size <= 64;
+  }
+
+  size_t To(const char* text, const size_t size) const {
+    const uint64_t last = uint64_t(1) << (_size - 1);
+    uint64_t vp = (_size == 64) ? ~uint64_t(0) : (last << 1) - 1;
+    uint64_t vn = 0;
+    size_t score = _size;
+    for (size_t j = 0; j < size; ++j) {
+      const uint64_t eq = _peq[static_cast<uint8_t>(text[j])];
+      const uint64_t x = eq | vn;
+      const uint64_t d0 = (((x & vp) + vp) ^ vp) | x;
+      const uint64_t hn = vp & d0;
+      const uint64_t hp = vn | ~(vp | d0);
+      if (hp & last)
+        ++score;
+      else if (hn & last)
+        --score;
+      const uint64_t shifted = (hp << 1) | 1;
+      vn = shifted & d0;
+      vp = (hn << 1) | ~(shifted | d0);
+    }
+    return score;
+  }
+
+ private:
+  uint64_t _peq[256] = {};
+  size_t _size;
+};
+
+// Bounds on the input accepted by Initialize(), for command lines from untrusted sources. Zero
+// means unlimited. Tokenization checks the sizes before copying anything, and parsing stops as soon
+// as a flag repeats too often or the step budget runs out.
+struct ParseLimits {
+  size_t max_tokens = 0;        // Arguments after the program name
+  size_t max_token_length = 0;  // Bytes in one argument
+  size_t max_total_bytes = 0;   // Bytes in all arguments
+  size_t max_repetitions = 0;   // Occurrences of one flag, by its name or alias
+  size_t max_steps = 0;         // Arguments, cluster characters and list elements examined
+
+  // Limits generous for any hand written command line
+  static ParseLimits Hardened() {
+    ParseLimits limits;
+    limits.max_tokens = 1024;
+    limits.max_token_length = 4096;
+    limits.max_total_bytes = 64 * 1024;
+    limits.max_repetitions = 64;
+    limits.max_steps = 64 * 1024;
+    return limits;
+  }
+};
+
+// One command line argument, split once at the first '=' for flags given as --flag=value
+struct Token {
+  std::string text;
+  std::string name;
+  std::string value;
+  bool flag = false;       // Starts with '-' and is not a lone "-"
+  bool has_value = false;
+};
+
+// Arguments tokenized once so any number of Args instances can read the same command line with
+// Args::Bind(). Each instance claims the tokens it recognizes.
+class TokenizedArgv {
+ public:
+  TokenizedArgv(int argc, char* argv[], const ParseLimits& limits = ParseLimits()) {
+    _error = CheckLimits(argc, argv, limits);
+    if (!_error.empty())
+      argc = 0;
+    _binary = (argc > 0) ? argv[0] : "";
+    for (int i = 1; i < argc; ++i) {
+      Token token;
+      token.text = argv[i];
+      token.flag = (token.text.size() > 1 && token.text[0] == '-');
+      const size_t pos = token.text.find('=');
+      token.has_value = (pos != std::string::npos);
+      token.name = token.text.substr(0, pos);
+      if (token.has_value)
+        token.value = token.text.substr(pos + 1);
+      _tokens.push_back(token);
+    }
+    _claimed.assign(_tokens.size(), false);
+  }
+
+  const std::string& Binary() const {
+    return _binary;
+  }
+
+  // Why the arguments were rejected by the limits, or ""
+  const std::string& Error() const {
+    return _error;
+  }
+
+  const std::vector<Token>& Tokens() const {
+    return _tokens;
+  }
+
+  void Claim(const size_t index) {
+    _claimed[index] = true;
+  }
+
+  bool Claimed(const size_t index) const {
+    return _claimed[index];
+  }
+
+  // Arguments that no bound instance recognized, in command line order
+  std::vector<std::string> Unclaimed() const {
+    std::vector<std::string> unclaimed;
+    for (size_t i = 0; i < _tokens.size(); ++i) {
+      if (!_claimed[i])
+        unclaimed.push_back(_tokens[i].text);
+    }
+    return unclaimed;
+  }
+
+ private:
+  std::string _binary;
+  std::vector<Token> _tokens;
+  std::string _error;
+  std::vector<bool> _claimed;
+
+  // Reads at most the limit of each argument, so oversized input is rejected in bounded time
+  static std::string CheckLimits(const int argc, char* argv[], const ParseLimits& limits) {
+    if (limits.max_tokens != 0 && argc > 1 && static_cast<size_t>(argc - 1) > limits.max_tokens)
+      return "More than " + std::to_string(limits.max_tokens) + " arguments";
+    if (limits.max_token_length == 0 && limits.max_total_bytes == 0)
+      return "";
+
+    size_t total = 0;
+    for (int i = 0; i < argc; ++i) {
+      size_t bound = std::numeric_limits<size_t>::max() - 1;
+      if (limits.max_token_length != 0)
+        bound = limits.max_token_length;
+      if (limits.max_total_bytes != 0)
+        bound = std::min(bound, limits.max_total_bytes - total);
+      const size_t length = strnlen(argv[i], bound + 1);
+      if (limits.max_token_length != 0 && length > limits.max_token_length)
+        return "Argument " + std::to_string(i) + " is longer than " + std::to_string(limits.max_token_length) +
+               " bytes";
+      total += length;
+      if (limits.max_total_bytes != 0 && total > limits.max_total_bytes)
+        return "Arguments are longer than " + std::to_string(limits.max_total_bytes) + " bytes";
+    }
+    return "";
+  }
+};
+
+// An unrecognized flag held in permissive mode until a late registration claims it
+struct PendingFlag {
+  std::string value;
+  std::string next;
+  int position = 0;
+  bool has_value = false;  // Value was attached with '='
+  bool has_next = false;   // A non-flag followed and becomes the value if a value flag claims it
+};
+
+// Completion of an InitializeAsync() shared by copies of the instance
+struct AsyncState {
+  // The background thread writes to the state, so it must finish first
+  ~AsyncState() {
+    if (worker.valid())
+      worker.wait();
+  }
+
+  std::atomic<bool> ready{false};
+  std::shared_future<void> worker;  // Parses on the background thread
+  std::shared_future<void> future;  // Deferred, reports the result on the thread that waits for it
+  bool help = false;                // Written by the worker for the report
+  bool answered = false;            // A hidden schema argument was answered
+};
+
+// Read counts of each flag name, created by Initialize() so getters find a name in one hash lookup
+typedef std::unordered_map<std::string, std::atomic<uint64_t>> ReadCounters;
+
+// Mutex guarding state a const method fills in lazily. Copies of the owner get their own.
+struct CopyableMutex {
+  CopyableMutex() = default;
+
+  CopyableMutex(const CopyableMutex&) {}
+
+  CopyableMutex& operator=(const CopyableMutex&) {
+    return *this;
+  }
+
+  std::mutex mutex;
+};
+
+// Quotes and escapes text as a JSON string
+inline std::string JsonString(const std::string& text) {
+  std::stringstream output;
+  output << '"';
+  for (const char c : text) {
+    switch (c) {
+      case '"': output << "\\\""; break;
+      case '\\': output << "\\\\"; break;
+      case '\n': output << "\\n"; break;
+      case '\r': output << "\\r"; break;
+      case '\t': output << "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20)
+          output << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        else
+          output << c;
+    }
+  }
+  output << '"';
+  return output.str();
+}
+
+inline const char* KindName(const ArgumentKind kind) {
+  switch (kind) {
+    case ArgumentKind::kEnum: return "enum";
+    case ArgumentKind::kSet: return "set";
+    case ArgumentKind::kSweep: return "sweep";
+    case ArgumentKind::kMap: return "map";
+    case ArgumentKind::kHex: return "hex";
+    case ArgumentKind::kBase64: return "base64";
+    case ArgumentKind::kNumber: return "number";
+    default: return "plain";
+  }
+}
+
+// Where the effective value of a flag came from
+enum class ValueSource {
+  kUnset,
+  kCommandLine,
+  kFallback,
+  kPinned
+};
+
+inline const char* SourceName(const ValueSource source) {
+  switch (source) {
+    case ValueSource::kCommandLine: return "command line";
+    case ValueSource::kFallback: return "fallback";
+    case ValueSource::kPinned: return "pinned";
+    default: return "unset";
+  }
+}
+
+// Effective state of one registered flag, for introspection
+struct FlagState {
+  std::string flag;
+  std::string alias;
+  std::string value;
+  ValueSource source = ValueSource::kUnset;
+  uint64_t reads = 0;  // Only counted when SARGS_COUNT_READS is defined
+};
+
+// Durations of the phases of the last Initialize(), in nanoseconds
+struct InitializeTimings {
+  uint64_t parse = 0;
+  uint64_t fallbacks = 0;
+  uint64_t decode = 0;
+  uint64_t fingerprint = 0;
+  uint64_t hooks = 0;
+  uint64_t total = 0;
+  uint64_t count = 0;  // Number of initializations
+};
+
+struct PinnedValue {
+  bool present = false;
+  std::string value;
+};
+
+class ScopedArgs;
+
 class Args {
  public:
   Args() = default;
 
-  ~Args() = default;
+  // An InitializeAsync() worker writes to every member, so it must finish before any is destroyed
+  ~Args() {
+    if (_async && _async->worker.valid())
+      _async->worker.wait();
+  }
 
   static Args& Default() {
     static Args instance;
     return instance;
   }
 
+  // The instance the SARGS_* macros use on this thread: the innermost ScopedArgs, or Default().
+  // Without a scope this costs one thread local load over Default()
+  static Args& Current() {
+    Args* scoped = Scoped();
+    return (scoped != nullptr) ? *scoped : Default();
+  }
+
   bool GetAsString(const std::string& flag, std::string& value) const {
+    this->WaitUntilReady();
+    this->CountRead(flag);
     if (flag.empty()) {
       if (_exceptions_enabled)
         throw SargsError("Flag query empty");
@@ -81,6 +1764,8 @@ class Args {
   }
 
   bool GetAsFloat(const std::string& flag, float& value) const {
+    this->WaitUntilReady();
+    this->CountRead(flag);
     if (flag.empty()) {
       if (_exceptions_enabled)
         throw SargsError("Flag query empty");
@@ -109,6 +1794,8 @@ class Args {
   }
 
   bool GetAsUInt64(const std::string& flag, uint64_t& value) const {
+    this->WaitUntilReady();
+    this->CountRead(flag);
     if (flag.empty()) {
       if (_exceptions_enabled)
         throw SargsError("Flag query empty");
@@ -206,6 +1893,8 @@ class Args {
   }
 
   bool GetAsInt64(const std::string& flag, int64_t& value) const {
+    this->WaitUntilReady();
+    this->CountRead(flag);
     if (flag.empty()) {
       if (_exceptions_enabled)
         throw SargsError("Flag query empty");
@@ -268,119 +1957,562 @@ class Args {
     return static_cast<int32_t>(value);
   }
 
-  int16_t GetAsInt16(const std::string& flag) const {
+  int16_t GetAsInt16(const std::string& flag) const {
+    int64_t value;
+    if (!this->GetAsInt64(flag, value)) {
+      if (_exceptions_enabled)
+        throw SargsError(flag + " was not specified");
+      else
+        return 0;
+    }
+    if (value > std::numeric_limits<int16_t>::max()) {
+      if (_exceptions_enabled)
+        throw SargsError(flag + " is too large to convert to int16_t: " + std::to_string(value));
+      else
+        return 0;
+    } else if (value < std::numeric_limits<int16_t>::min()) {
+      if (_exceptions_enabled)
+        throw SargsError(flag + " is too small to convert to int16_t: " + std::to_string(value));
+      else
+        return 0;
+    }
+    return static_cast<int16_t>(value);
+  }
+
+  int32_t GetAsInt8(const std::string& flag) const {
+    int64_t value;
+    if (!this->GetAsInt64(flag, value)) {
+      if (_exceptions_enabled)
+        throw SargsError(flag + " was not specified");
+      else
+        return 0;
+    }
+    if (value > std::numeric_limits<int8_t>::max()) {
+      if (_exceptions_enabled)
+        throw SargsError(flag + " is too large to convert to int8_t: " + std::to_string(value));
+      else
+        return 0;
+    } else if (value < std::numeric_limits<int8_t>::min()) {
+      if (_exceptions_enabled)
+        throw SargsError(flag + " is too small to convert to int8_t: " + std::to_string(value));
+      else
+        return 0;
+    }
+    return static_cast<int8_t>(value);
+  }
+
+  bool GetAsEnum(const std::string& flag, int64_t& value) const {
+    this->WaitUntilReady();
+    this->CountRead(flag);
+    if (flag.empty()) {
+      if (_exceptions_enabled)
+        throw SargsError("Flag query empty");
+      else
+        return false;
+    }
+
+    auto iter = _decoded.find(flag);
+    if (iter == _decoded.end())
+      return false;
+    value = static_cast<int64_t>(iter->second);
+    return true;
+  }
+
+  // Stable hash of the effective configuration computed during Initialize(). Aliases resolve to
+  // their flag, fallbacks are included, numbers are normalized and non-semantic flags are skipped
+  // so equivalent command lines produce the same fingerprint.
+  uint64_t Fingerprint() const {
+    this->WaitUntilReady();
+    return _fingerprint;
+  }
+
+  // Approximate bytes held by this instance, by category, plus the shared name table. Map and
+  // hash table nodes are estimated, so use it to track trends rather than exact sizes.
+  MemoryReport MemoryUsage() const {
+    this->WaitUntilReady();
+    std::lock_guard<std::mutex> state_lock(_state_mutex.mutex);
+    MemoryReport report;
+    report.registry = RegistryBytes(_required) + RegistryBytes(_optional) + HeapBytes(_name_buffer) +
+      _name_hashes.capacity() * sizeof(uint64_t) + _name_traits.capacity() +
+      _name_arguments.capacity() * sizeof(uint32_t) + _name_offsets.capacity() * sizeof(uint32_t) +
+      _index.capacity() * sizeof(_index[0]) + StringMapBytes(_accumulating) + MapBytes(_pinned) +
+      _initialize_hooks.capacity() * sizeof(_initialize_hooks[0]);
+    for (const auto& flag : _non_semantic)
+      report.registry += sizeof(flag) + 4 * sizeof(void*) + HeapBytes(flag);
+    report.descriptions = HeapBytes(_descriptions);
+    report.values = StringMapBytes(_arguments) + MapBytes(_decoded) + MapBytes(_maps) +
+      _nonflags.capacity() * sizeof(std::string) + _nonflag_positions.capacity() * sizeof(int);
+    for (const auto& iter : _maps)
+      report.values += iter.second.MemoryUsage();
+    report.values += MapBytes(_bytes);
+    for (const auto& iter : _bytes)
+      report.values += iter.second.MemoryUsage();
+    for (const auto& iter : _pending)
+      report.values += sizeof(iter) + 2 * sizeof(void*) + HeapBytes(iter.first) + HeapBytes(iter.second.value) +
+        HeapBytes(iter.second.next);
+    for (const auto& nonflag : _nonflags)
+      report.values += HeapBytes(nonflag);
+    {
+      std::lock_guard<std::mutex> lock(_usage_mutex.mutex);
+      report.usage = HeapBytes(_binary) + HeapBytes(_flag_description) + HeapBytes(_preamble) +
+        HeapBytes(_epilogue) + HeapBytes(_help_index) + _help_offsets.capacity() * sizeof(size_t);
+    }
+    report.names = NameTable::Instance().MemoryUsage();
+    return report;
+  }
+
+  // The cartesian product of all sweep flags, built during Initialize()
+  const Sweep& GetSweep() const {
+    this->WaitUntilReady();
+    return _sweep;
+  }
+
+  // Entries of a map flag from every occurrence. Flags that were not specified give an empty map
+  const FlatMap& GetAsMap(const std::string& flag) const {
+    this->WaitUntilReady();
+    this->CountRead(flag);
+    static const FlatMap empty;
+    auto iter = _maps.find(flag);
+    if (iter == _maps.end())
+      iter = _maps.find(this->FindAlternative(flag));
+    return (iter == _maps.end()) ? empty : iter->second;
+  }
+
+  // Bytes decoded from a hex or base64 flag during Initialize(), valid until the next one. Flags
+  // that were not specified give an empty span
+  ByteSpan GetAsBytes(const std::string& flag) const {
+    this->WaitUntilReady();
+    this->CountRead(flag);
+    auto iter = _bytes.find(flag);
+    if (iter == _bytes.end())
+      iter = _bytes.find(this->FindAlternative(flag));
+    return (iter == _bytes.end()) ? ByteSpan() : iter->second.Bytes();
+  }
+
+  int64_t GetAsEnum(const std::string& flag) const {
     int64_t value;
-    if (!this->GetAsInt64(flag, value)) {
+    if (!this->GetAsEnum(flag, value)) {
       if (_exceptions_enabled)
         throw SargsError(flag + " was not specified");
       else
         return 0;
     }
-    if (value > std::numeric_limits<int16_t>::max()) {
-      if (_exceptions_enabled)
-        throw SargsError(flag + " is too large to convert to int16_t: " + std::to_string(value));
-      else
-        return 0;
-    } else if (value < std::numeric_limits<int16_t>::min()) {
+    return value;
+  }
+
+  template <typename T>
+  T GetAsEnum(const std::string& flag) const {
+    return static_cast<T>(this->GetAsEnum(flag));
+  }
+
+  // Set flags that were not specified decode to an empty set rather than an error
+  uint64_t GetAsBitmask(const std::string& flag) const {
+    this->WaitUntilReady();
+    this->CountRead(flag);
+    if (flag.empty()) {
       if (_exceptions_enabled)
-        throw SargsError(flag + " is too small to convert to int16_t: " + std::to_string(value));
+        throw SargsError("Flag query empty");
       else
         return 0;
     }
-    return static_cast<int16_t>(value);
+
+    auto iter = _decoded.find(flag);
+    if (iter == _decoded.end())
+      return 0;
+    return iter->second;
   }
 
-  int32_t GetAsInt8(const std::string& flag) const {
-    int64_t value;
-    if (!this->GetAsInt64(flag, value)) {
-      if (_exceptions_enabled)
-        throw SargsError(flag + " was not specified");
-      else
-        return 0;
+  // Resolves every flag registered as --<name>.<flag> once. The lookup is proportional to the size
+  // of the namespace, not to the number of flags.
+  ArgsScope Scope(const std::string& name) const {
+    this->WaitUntilReady();
+    const std::string prefix("--" + name + ".");
+    std::vector<std::string> names;
+    std::map<std::string, std::string> values;
+    for (auto iter = std::lower_bound(_index.begin(), _index.end(), prefix, IndexLess);
+         iter != _index.end() && iter->first.Text().compare(0, prefix.size(), prefix) == 0; ++iter) {
+      const std::string short_name(iter->first.Text().substr(prefix.size()));
+      names.push_back(short_name);
+
+      auto arg_iter = _arguments.find(iter->first);
+      if (arg_iter == _arguments.end() && !iter->second.Empty())
+        arg_iter = _arguments.find(iter->second);
+      if (arg_iter != _arguments.end())
+        values[short_name] = arg_iter->second;
     }
-    if (value > std::numeric_limits<int8_t>::max()) {
-      if (_exceptions_enabled)
-        throw SargsError(flag + " is too large to convert to int8_t: " + std::to_string(value));
-      else
-        return 0;
-    } else if (value < std::numeric_limits<int8_t>::min()) {
-      if (_exceptions_enabled)
-        throw SargsError(flag + " is too small to convert to int8_t: " + std::to_string(value));
-      else
-        return 0;
+    return ArgsScope(name, names, values);
+  }
+
+  // Completion candidates for words[index] of a command line, with words[0] the program. Flags and
+  // aliases complete from their prefix and enum or set flags from their choices, after a space or
+  // '='. No candidates means the shell should complete file names.
+  std::vector<std::string> Complete(const std::vector<std::string>& words, const size_t index) const {
+    this->WaitUntilReady();
+    std::set<std::string> candidates;
+    const std::string current = (index < words.size()) ? words[index] : "";
+    for (size_t i = 1; i < index && i < words.size(); ++i) {
+      if (words[i] == "--")
+        return std::vector<std::string>();
     }
-    return static_cast<int8_t>(value);
+
+    std::string flag;
+    std::string typed;
+    const size_t equals = current.find('=');
+    if (current.size() > 1 && current[0] == '-' && equals != std::string::npos) {
+      flag = current.substr(0, equals);
+      typed = current.substr(equals + 1);
+    } else if (index >= 2 && index - 1 < words.size() && this->CheckIfValueFlag(words[index - 1])) {
+      flag = words[index - 1];
+      typed = current;
+    }
+
+    if (!flag.empty()) {
+      const int entry = this->FindName(flag);
+      if (entry < 0 || (_name_traits[entry] & kTraitValue) == 0)
+        return std::vector<std::string>();
+      const Argument& argument = this->ArgumentOf(entry);
+      // Sets complete the element after the last comma
+      const size_t comma = (argument.kind == ArgumentKind::kSet) ? typed.rfind(',') : std::string::npos;
+      const std::string prefix(current.substr(0, current.size() - typed.size()) +
+                               (comma == std::string::npos ? "" : typed.substr(0, comma + 1)));
+      const std::string partial(comma == std::string::npos ? typed : typed.substr(comma + 1));
+      for (const auto& choice : argument.choices.Choices()) {
+        if (choice.name.compare(0, partial.size(), partial) == 0)
+          candidates.insert(prefix + choice.name);
+      }
+      return std::vector<std::string>(candidates.begin(), candidates.end());
+    }
+
+    if (current.empty() || current[0] != '-')
+      return std::vector<std::string>();
+    for (size_t i = 0; i < _name_hashes.size(); ++i) {
+      const std::string name(_name_buffer, _name_offsets[i], _name_offsets[i + 1] - _name_offsets[i]);
+      if (name.compare(0, current.size(), current) == 0 && this->FindPinned(name) == _pinned.end())
+        candidates.insert(name);
+    }
+    return std::vector<std::string>(candidates.begin(), candidates.end());
   }
 
-  std::string FindAlternative(const std::string& flag) const {
-    for (auto iter : _required) {
-      if (iter.flag == flag)
-        return iter.alias;
-      if (iter.alias == flag)
-        return iter.flag;
-    }
-    for (auto iter : _optional) {
-      if (iter.flag == flag)
-        return iter.alias;
-      if (iter.alias == flag)
-        return iter.flag;
+  // Bash or zsh script that completes the program through --sargs-complete. Load it with
+  // source <(program --sargs-complete-script bash) or eval "$(program --sargs-complete-script zsh)".
+  std::string CompletionScript(const std::string& shell) const {
+    this->WaitUntilReady();
+    const std::string program(_binary.substr(_binary.find_last_of('/') + 1));
+    std::string function("_sargs_complete_" + program);
+    for (auto& c : function) {
+      if (!std::isalnum(static_cast<unsigned char>(c)))
+        c = '_';
     }
-    return "";
+
+    std::stringstream script;
+    if (shell == "bash") {
+      // Bash splits words at '=', so words are rebuilt from the line and the part of a candidate
+      // before the current bash word is removed
+      script << function << "() {\n"
+             << "  local line=\"${COMP_LINE:0:$COMP_POINT}\" cur=\"${COMP_WORDS[COMP_CWORD]}\" IFS=$' \\t\\n'\n"
+             << "  local -a words candidates\n"
+             << "  read -ra words <<< \"$line\"\n"
+             << "  [[ \"$line\" == *[[:space:]] ]] && words+=(\"\")\n"
+             << "  local last=\"${words[${#words[@]}-1]}\"\n"
+             << "  local typed=\"${last%\"$cur\"}\"\n"
+             << "  IFS=$'\\n' candidates=($(\"$1\" --sargs-complete $((${#words[@]} - 1)) "
+                "\"${words[@]}\" 2>/dev/null))\n"
+             << "  COMPREPLY=(\"${candidates[@]#\"$typed\"}\")\n"
+             << "}\n"
+             << "complete -o default -F " << function << ' ' << program << "\n";
+    } else if (shell == "zsh") {
+      script << "#compdef " << program << "\n"
+             << function << "() {\n"
+             << "  local -a candidates\n"
+             << "  candidates=(${(f)\"$(\"${words[1]}\" --sargs-complete $((CURRENT - 1)) "
+                "\"${words[@]}\" 2>/dev/null)\"})\n"
+             << "  if (( ${#candidates} )); then\n"
+             << "    compadd -Q -- \"${candidates[@]}\"\n"
+             << "  else\n"
+             << "    _files\n"
+             << "  fi\n"
+             << "}\n"
+             << "compdef " << function << ' ' << program << "\n";
+    }
+    return script.str();
+  }
+
+  std::string FindAlternative(const std::string& flag) const {
+    this->WaitUntilReady();
+    const int entry = this->FindName(flag);
+    if (entry < 0)
+      return "";
+    const Argument& argument = this->ArgumentOf(entry);
+    return argument.flag == flag ? argument.alias : argument.flag;
   }
 
   bool Has(const std::string& flag) const {
-    std::string alternative = this->FindAlternative(flag);
-    for (auto iter : _arguments) {
-      if ((iter.first == flag) || (iter.first == alternative))
-        return true;
-    }
-    return false;
+    this->WaitUntilReady();
+    this->CountRead(flag);
+    if (_arguments.count(flag) > 0)
+      return true;
+    const std::string alternative = this->FindAlternative(flag);
+    return !alternative.empty() && _arguments.count(alternative) > 0;
   }
 
   std::string GetNonFlag(const size_t index) const {
+    this->WaitUntilReady();
     return _nonflags.at(index);
   }
 
   std::vector<std::string> GetNonFlags() const {
+    this->WaitUntilReady();
     return _nonflags;
   }
 
-  void AddRequiredFlag(const std::string& flag, const std::string& alias, const std::string& description) {
-    _required.emplace_back(flag, alias, description, false);
+  void AddRequiredFlag(const std::string& flag, const std::string& alias, const DescriptionText& description) {
+    this->Register(_required, flag, alias, description, false);
   }
 
- void AddRequiredFlagValue(const std::string& flag, const std::string& alias, const std::string& description) {
-    _required.emplace_back(flag, alias, description, true, "");
+ void AddRequiredFlagValue(const std::string& flag, const std::string& alias,
+                           const DescriptionText& description) {
+    this->Register(_required, flag, alias, description, true, "");
  }
 
-  void AddRequiredFlagValue(const std::string& flag, const std::string& alias, const std::string& description,
-                            const std::string& fallback) {
-    _required.emplace_back(flag, alias, description, true, fallback);
+  void AddRequiredFlagValue(const std::string& flag, const std::string& alias,
+                            const DescriptionText& description, const std::string& fallback) {
+    this->Register(_required, flag, alias, description, true, fallback);
+  }
+
+  void AddOptionalFlag(const std::string& flag, const std::string& alias, const DescriptionText& description) {
+    this->Register(_optional, flag, alias, description, false);
+  }
+
+  void AddOptionalFlagValue(const std::string& flag, const std::string& alias,
+                            const DescriptionText& description) {
+    this->Register(_optional, flag, alias, description, true, "");
+  }
+
+  void AddOptionalFlagValue(const std::string& flag, const std::string& alias,
+                            const DescriptionText& description, const std::string& fallback) {
+    this->Register(_optional, flag, alias, description, true, fallback);
+  }
+
+  void AddRequiredFlagEnum(const std::string& flag, const std::string& alias,
+                           const DescriptionText& description, const std::vector<Choice>& choices) {
+    this->Register(_required, flag, alias, description, "", ArgumentKind::kEnum, choices);
+  }
+
+  void AddOptionalFlagEnum(const std::string& flag, const std::string& alias,
+                           const DescriptionText& description, const std::vector<Choice>& choices,
+                           const std::string& fallback = "") {
+    this->Register(_optional, flag, alias, description, fallback, ArgumentKind::kEnum, choices);
+  }
+
+  void AddRequiredFlagSet(const std::string& flag, const std::string& alias, const DescriptionText& description,
+                          const std::vector<std::string>& names) {
+    this->Register(_required, flag, alias, description, "", ArgumentKind::kSet, this->NumberChoices(names));
+  }
+
+  void AddOptionalFlagSet(const std::string& flag, const std::string& alias, const DescriptionText& description,
+                          const std::vector<std::string>& names, const std::string& fallback = "") {
+    this->Register(_optional, flag, alias, description, fallback, ArgumentKind::kSet,
+                   this->NumberChoices(names));
+  }
+
+  void AddRequiredFlagSweep(const std::string& flag, const std::string& alias,
+                            const DescriptionText& description) {
+    this->Register(_required, flag, alias, description, "", ArgumentKind::kSweep, std::vector<Choice>());
+  }
+
+  void AddOptionalFlagSweep(const std::string& flag, const std::string& alias,
+                            const DescriptionText& description, const std::string& fallback = "") {
+    this->Register(_optional, flag, alias, description, fallback, ArgumentKind::kSweep, std::vector<Choice>());
+  }
+
+  // Map flags accept key=value or key:value entries, comma separated, and may be repeated
+  void AddRequiredFlagMap(const std::string& flag, const std::string& alias,
+                          const DescriptionText& description) {
+    this->Register(_required, flag, alias, description, "", ArgumentKind::kMap, std::vector<Choice>());
+    this->Accumulate(flag, alias);
+  }
+
+  void AddOptionalFlagMap(const std::string& flag, const std::string& alias,
+                          const DescriptionText& description) {
+    this->Register(_optional, flag, alias, description, "", ArgumentKind::kMap, std::vector<Choice>());
+    this->Accumulate(flag, alias);
+  }
+
+  // Requires every value of a value, map or sweep flag to match a restricted regular expression, see
+  // Pattern. Map flags check each entry's value and sweeps each expanded value. The expression is
+  // compiled here, and throws SargsError if it is invalid or the flag can't take it.
+  void SetPattern(const std::string& flag, const std::string& expression) {
+    const int entry = this->FindName(flag);
+    if (entry < 0)
+      throw SargsError("Cannot set a pattern for unknown flag " + flag);
+    Argument& argument = this->ArgumentOf(entry);
+    if (!argument.value || (argument.kind != ArgumentKind::kPlain && argument.kind != ArgumentKind::kMap &&
+                            argument.kind != ArgumentKind::kSweep))
+      throw SargsError("Patterns only apply to value, map and sweep flags, not " + flag);
+    argument.pattern = std::make_shared<const Pattern>(expression);
+    _usage_stale = true;
+  }
+
+  // Binary flags decode their value once at Initialize(), read it with GetAsBytes()
+  void AddRequiredFlagHex(const std::string& flag, const std::string& alias,
+                          const DescriptionText& description) {
+    this->Register(_required, flag, alias, description, "", ArgumentKind::kHex, std::vector<Choice>());
+  }
+
+  void AddOptionalFlagHex(const std::string& flag, const std::string& alias, const DescriptionText& description,
+                          const std::string& fallback = "") {
+    this->Register(_optional, flag, alias, description, fallback, ArgumentKind::kHex, std::vector<Choice>());
+  }
+
+  void AddRequiredFlagBase64(const std::string& flag, const std::string& alias,
+                             const DescriptionText& description) {
+    this->Register(_required, flag, alias, description, "", ArgumentKind::kBase64, std::vector<Choice>());
+  }
+
+  void AddOptionalFlagBase64(const std::string& flag, const std::string& alias,
+                             const DescriptionText& description, const std::string& fallback = "") {
+    this->Register(_optional, flag, alias, description, fallback, ArgumentKind::kBase64, std::vector<Choice>());
+  }
+
+  // Number flags must hold an integer, possibly hex or octal, or a floating point value. Equal numbers
+  // in different notations, like 16, 0x10 and 1.6e1, share a fingerprint.
+  void AddRequiredFlagNumber(const std::string& flag, const std::string& alias,
+                             const DescriptionText& description) {
+    this->Register(_required, flag, alias, description, "", ArgumentKind::kNumber, std::vector<Choice>());
+  }
+
+  void AddOptionalFlagNumber(const std::string& flag, const std::string& alias,
+                             const DescriptionText& description, const std::string& fallback = "") {
+    this->Register(_optional, flag, alias, description, fallback, ArgumentKind::kNumber, std::vector<Choice>());
+  }
+
+  // Pins a flag without a value to being present or absent. Specifying it on the command line is an error
+  void PinFlag(const std::string& flag, const bool enabled) {
+    PinnedValue pinned;
+    pinned.present = enabled;
+    _pinned[flag] = pinned;
   }
 
-  void AddOptionalFlag(const std::string& flag, const std::string& alias, const std::string& description) {
-    _optional.emplace_back(flag, alias, description, false);
+  // Pins a value flag. Specifying it on the command line is an error
+  void PinFlagValue(const std::string& flag, const std::string& value) {
+    PinnedValue pinned;
+    pinned.present = true;
+    pinned.value = value;
+    _pinned[flag] = pinned;
   }
 
-  void AddOptionalFlagValue(const std::string& flag, const std::string& alias, const std::string& description) {
-    _optional.emplace_back(flag, alias, description, true, "");
+  // Excludes a flag that does not change results, such as verbosity, from Fingerprint()
+  void MarkNonSemantic(const std::string& flag) {
+    _non_semantic.insert(flag);
   }
 
-  void AddOptionalFlagValue(const std::string& flag, const std::string& alias, const std::string& description,
-                            const std::string& fallback) {
-    _optional.emplace_back(flag, alias, description, true, fallback);
+  // Runs after every Initialize(), e.g. to push parsed values into code or caches that mirror them
+  void AddInitializeHook(const std::function<void(const Args&)>& hook) {
+    _initialize_hooks.push_back(hook);
   }
 
   void RequireNonFlags(const int count) {
     _nonflags_required = count;
   }
 
+  // Usage is rendered once, on first use and under a lock, so descriptions cost nothing unless usage
+  // is printed or queried. Const readers may render it concurrently.
   void PrintUsage(std::ostream& output) {
+    this->WaitUntilReady();
+    this->GenerateUsage();
     output << _preamble << _flag_description << _epilogue;
   }
 
+  // Prints only the flags of the group named filter, or else the flags whose name, alias or
+  // description contains filter, ignoring case. This is what --help=<filter> prints. Only the
+  // matching flags are formatted.
+  void PrintUsage(std::ostream& output, const std::string& filter) const {
+    this->WaitUntilReady();
+    const std::string needle = Lowercase(filter);
+    std::vector<const Argument*> matches;
+    std::string title;
+    for (size_t group = 1; group < _groups.size() && title.empty(); ++group) {
+      if (Lowercase(_groups[group]) != needle)
+        continue;
+      title = _groups[group];
+      for (const auto* arguments : { &_required, &_optional }) {
+        for (const auto& argument : *arguments) {
+          if (argument.group == group)
+            matches.push_back(&argument);
+        }
+      }
+    }
+
+    if (title.empty() && !needle.empty()) {
+      title = "Flags matching \"" + filter + "\"";
+      this->BuildHelpIndex();
+      size_t position = _help_index.find(needle);
+      while (position != std::string::npos) {
+        const auto next = std::upper_bound(_help_offsets.begin(), _help_offsets.end(), position);
+        const size_t entry = static_cast<size_t>(next - _help_offsets.begin()) - 1;
+        matches.push_back(entry < _required.size() ? &_required[entry] : &_optional[entry - _required.size()]);
+        position = (next != _help_offsets.end()) ? _help_index.find(needle, *next) : std::string::npos;
+      }
+    }
+
+    if (matches.empty())
+      output << "No flags match \"" << filter << "\"\n";
+    else
+      output << "\n  " << title << ":\n";
+    for (const auto* argument : matches) {
+      const bool required = argument >= _required.data() && argument < _required.data() + _required.size();
+      output << this->FormatArgument(*argument, required);
+    }
+
+    if (_groups.size() > 1) {
+      output << "\n  Groups:";
+      for (size_t group = 1; group < _groups.size(); ++group)
+        output << (group == 1 ? " " : ", ") << _groups[group];
+      output << "\n";
+    }
+  }
+
+  // Registered flags and aliases closest to an unknown token by edit distance, best first. Only
+  // names within a third of the token's length are suggested.
+  std::vector<std::string> Suggestions(const std::string& token, const size_t count = 3) const {
+    this->WaitUntilReady();
+    const std::string name = token.substr(0, token.find('='));
+    const EditDistance distance(name);
+    std::vector<std::pair<size_t, size_t>> ranked;  // Distance and entry
+    if (!distance.Valid() || count == 0)
+      return {};
+
+    const size_t limit = std::max<size_t>(1, name.size() / 3);
+    for (size_t entry = 0; entry < _name_hashes.size(); ++entry) {
+      const size_t size = _name_offsets[entry + 1] - _name_offsets[entry];
+      if (size > name.size() + limit || size + limit < name.size())
+        continue;
+      const size_t score = distance.To(_name_buffer.data() + _name_offsets[entry], size);
+      if (score <= limit)
+        ranked.emplace_back(score, entry);
+    }
+    std::sort(ranked.begin(), ranked.end());
+
+    std::vector<std::string> suggestions;
+    for (size_t i = 0; i < ranked.size() && suggestions.size() < count; ++i) {
+      const size_t entry = ranked[i].second;
+      const uint32_t start = _name_offsets[entry];
+      suggestions.push_back(_name_buffer.substr(start, _name_offsets[entry + 1] - start));
+    }
+    return suggestions;
+  }
+
+  // Flags registered after this call are listed under group in usage and can be printed alone
+  // with --help=<group>. An empty group ends grouping.
+  void SetGroup(const std::string& group) {
+    _group = static_cast<uint32_t>(std::find(_groups.begin(), _groups.end(), group) - _groups.begin());
+    if (_group == _groups.size())
+      _groups.push_back(group);
+  }
+
   void SetPreamble(const std::string& preamble) {
     _preamble = preamble;
+    _custom_preamble = true;
   }
 
   void SetEpilogue(const std::string& epilogue) {
@@ -389,6 +2521,17 @@ class Args {
 
   void SetFlagDescription(const std::string& flag_description) {
     _flag_description = flag_description;
+    _custom_flag_description = true;
+  }
+
+  // Discards every flag description for processes that will never print usage. Usage still lists
+  // the flags. Descriptions of flags registered afterwards are dropped as well.
+  void Freeze() {
+    std::string().swap(_descriptions);
+    std::string().swap(_help_index);
+    _help_offsets.clear();
+    _frozen = true;
+    _usage_stale = true;
   }
 
   void DisableHelp() {
@@ -411,108 +2554,739 @@ class Args {
     _desc_start = column;
   }
 
-  void SetDescWidth(const unsigned width) {
-    _desc_width = width;
+  void SetDescWidth(const unsigned width) {
+    _desc_width = width;
+  }
+
+  std::string GetPreamble() const {
+    this->WaitUntilReady();
+    this->GenerateUsage();
+    return _preamble;
+  }
+
+  std::string GetEpilogue() const {
+    this->WaitUntilReady();
+    return _epilogue;
+  }
+
+  std::string GetFlagDescription() const {
+    this->WaitUntilReady();
+    this->GenerateUsage();
+    return _flag_description;
+  }
+
+  std::string GetBinary() const {
+    this->WaitUntilReady();
+    return _binary;
+  }
+
+  // Effective value and source of every registered flag. Reading it doesn't count as a read.
+  std::vector<FlagState> Inspect() const {
+    this->WaitUntilReady();
+    std::lock_guard<std::mutex> lock(_state_mutex.mutex);
+    std::vector<FlagState> states;
+    for (const auto* arguments : { &_required, &_optional }) {
+      for (const auto& argument : *arguments) {
+        FlagState state;
+        state.flag = argument.flag;
+        state.alias = argument.alias;
+        const std::string& name = argument.flag.Empty() ? argument.alias : argument.flag;
+        const int entry = this->FindName(name);
+        auto iter = _arguments.find(name);
+        if (this->FindPinned(name) != _pinned.end())
+          state.source = ValueSource::kPinned;
+        else if (entry >= 0 && static_cast<size_t>(entry) < _name_specified.size() && _name_specified[entry])
+          state.source = ValueSource::kCommandLine;
+        else if (iter != _arguments.end())
+          state.source = ValueSource::kFallback;
+        if (iter != _arguments.end())
+          state.value = iter->second;
+        for (const Name* read_name : { &argument.flag, &argument.alias }) {
+          auto read_iter = _reads ? _reads->find(*read_name) : ReadCounters::const_iterator();
+          if (_reads && read_iter != _reads->end())
+            state.reads += read_iter->second.load(std::memory_order_relaxed);
+        }
+        states.push_back(state);
+      }
+    }
+    return states;
+  }
+
+  InitializeTimings Timings() const {
+    this->WaitUntilReady();
+    std::lock_guard<std::mutex> lock(_state_mutex.mutex);
+    return _timings;
+  }
+
+  // Error reported by the last Initialize(), Bind(), ClaimPending() or CheckUnclaimed(), or ""
+  std::string GetError() const {
+    this->WaitUntilReady();
+    return _error;
+  }
+
+  // JSON description of every registered flag, the required non-flag count, the pinned flags and
+  // the parsing settings, which sargs::LoadSchema() in sargs_schema.h turns back into an equivalent
+  // Args. The help flag is left out since Initialize() registers it.
+  std::string Schema() const {
+    this->WaitUntilReady();
+    std::stringstream output;
+    output << "{\n  \"binary\": " << JsonString(_binary) << ",\n  \"nonflags\": " << _nonflags_required
+           << ",\n  \"help\": " << (_help_enabled ? "true" : "false")
+           << ",\n  \"permissive\": " << (_permissive ? "true" : "false")
+           << ",\n  \"hardened\": " << (_hardened ? "true" : "false")
+           << ",\n  \"limits\": {\"max_tokens\": " << _limits.max_tokens
+           << ", \"max_token_length\": " << _limits.max_token_length
+           << ", \"max_total_bytes\": " << _limits.max_total_bytes
+           << ", \"max_repetitions\": " << _limits.max_repetitions
+           << ", \"max_steps\": " << _limits.max_steps << '}'
+           << ",\n  \"flags\": [";
+    bool first = true;
+    for (const auto* arguments : { &_required, &_optional }) {
+      for (const auto& argument : *arguments) {
+        if (_help_enabled && argument.flag.Text() == "--help" && argument.alias.Text() == "-h")
+          continue;
+        output << (first ? "\n" : ",\n") << "    {\"flag\": " << JsonString(argument.flag)
+               << ", \"alias\": " << JsonString(argument.alias)
+               << ", \"required\": " << (arguments == &_required ? "true" : "false")
+               << ", \"value\": " << (argument.value ? "true" : "false")
+               << ", \"kind\": \"" << KindName(argument.kind) << '"'
+               << ", \"fallback\": " << JsonString(argument.fallback)
+               << ", \"description\": " << JsonString(this->Description(argument));
+        if (argument.group != 0)
+          output << ", \"group\": " << JsonString(_groups[argument.group]);
+        if (argument.pattern)
+          output << ", \"pattern\": " << JsonString(argument.pattern->Expression());
+        if (argument.kind == ArgumentKind::kEnum || argument.kind == ArgumentKind::kSet) {
+          output << ", \"choices\": [";
+          const std::vector<Choice>& choices = argument.choices.Choices();
+          for (size_t i = 0; i < choices.size(); ++i) {
+            output << (i == 0 ? "" : ", ") << "{\"name\": " << JsonString(choices[i].name)
+                   << ", \"value\": " << choices[i].value << '}';
+          }
+          output << ']';
+        }
+        output << '}';
+        first = false;
+      }
+    }
+    output << (first ? "" : "\n  ") << "],\n  \"pinned\": [";
+    first = true;
+    for (const auto& iter : _pinned) {
+      output << (first ? "\n" : ",\n") << "    {\"flag\": " << JsonString(iter.first)
+             << ", \"present\": " << (iter.second.present ? "true" : "false")
+             << ", \"value\": " << JsonString(iter.second.value) << '}';
+      first = false;
+    }
+    output << (first ? "" : "\n  ") << "]\n}\n";
+    return output.str();
+  }
+
+  // Limits the size of the command lines Initialize() accepts. Arguments tokenized elsewhere and
+  // given to Bind() are still held to the repetition and step limits.
+  void SetLimits(const ParseLimits& limits) {
+    _limits = limits;
+  }
+
+  const ParseLimits& GetLimits() const {
+    return _limits;
+  }
+
+  // For command lines from untrusted sources: applies ParseLimits::Hardened() and ignores the
+  // hidden --sargs-complete and --sargs-dump-schema arguments
+  void EnableHardened() {
+    _limits = ParseLimits::Hardened();
+    _hardened = true;
+  }
+
+  // Keeps unrecognized flags as pending entries instead of failing Initialize(). Flags registered
+  // later, e.g. by plugins, claim them with ClaimPending() and CheckUnclaimed() reports the rest.
+  void EnablePermissive() {
+    _permissive = true;
+  }
+
+  void Initialize(int argc, char* argv[]) {
+    TokenizedArgv tokens(argc, argv, _limits);
+    this->Initialize(tokens, false);
+  }
+
+  // Runs Initialize() on a background thread so other startup work can overlap it. Getters block
+  // until it completes and rethrow its exceptions. Errors still print usage and exit. Flags must
+  // not be registered and the instance must not be reconfigured until the returned future is ready.
+  std::shared_future<void> InitializeAsync(int argc, char* argv[]) {
+    std::shared_ptr<TokenizedArgv> tokens(new TokenizedArgv(argc, argv, _limits));
+    std::shared_ptr<AsyncState> state(new AsyncState());
+    AsyncState* raw_state = state.get();
+    _async = state;
+    state->worker = std::async(std::launch::async, [this, tokens, raw_state]() {
+      InitializingScope scope(raw_state);
+      this->Initialize(*tokens, false);
+    }).share();
+    // Usage is printed and the process exits on the thread that waits for the result, not the worker
+    state->future = std::async(std::launch::deferred, [this, raw_state]() {
+      raw_state->worker.get();
+      {
+        InitializingScope scope(raw_state);
+        if (!raw_state->answered)
+          this->Report(_error, raw_state->help);
+        else if (_exit_enabled)
+          exit(0);
+      }
+      raw_state->ready.store(true, std::memory_order_release);
+    }).share();
+    return state->future;
+  }
+
+  // Initializes from arguments tokenized once and shared with other instances. Only this instance's
+  // flags are read and claimed, and non-flags after "--" are taken only if RequireNonFlags() was set.
+  // Use TokenizedArgv::Unclaimed() once every instance is bound to find arguments nobody recognized.
+  void Bind(TokenizedArgv& tokens) {
+    this->Initialize(tokens, true);
+  }
+
+  // Binds flags registered since Initialize() or the last claim to the pending entries. Only the
+  // new flags are visited. Errors are reported like Initialize() and false is returned.
+  bool ClaimPending() {
+    std::unique_lock<std::mutex> lock(_state_mutex.mutex);
+    const std::vector<Argument> required(_required.begin() + _required_bound, _required.end());
+    const std::vector<Argument> optional(_optional.begin() + _optional_bound, _optional.end());
+    _required_bound = _required.size();
+    _optional_bound = _optional.size();
+
+    std::string result = this->Claim(required);
+    if (result.empty())
+      result = this->Claim(optional);
+    if (result.empty())
+      result = this->CheckForValues(required);
+    if (result.empty())
+      result = this->CheckForValues(optional);
+    if (result.empty())
+      result = this->CheckForMissing(required);
+    this->MarkSpecified();
+    this->AddFallbackValues(optional);
+    this->AddFallbackValues(required);
+    if (result.empty())
+      result = this->DecodeValues(required);
+    if (result.empty())
+      result = this->DecodeValues(optional);
+    lock.unlock();
+
+    if (!result.empty()) {
+      _usage_stale = true;
+      this->Report(result, false);
+    }
+    return result.empty();
+  }
+
+  // Fails like Initialize() if any pending flag was never claimed or the non-flag count is wrong
+  bool CheckUnclaimed() {
+    std::string result;
+    if (!_pending.empty()) {
+      std::vector<std::pair<int, std::string>> unclaimed;
+      for (const auto& iter : _pending)
+        unclaimed.emplace_back(iter.second.position, iter.first);
+      std::sort(unclaimed.begin(), unclaimed.end());
+
+      result = "Unknown arguments:";
+      for (size_t i = 0; i < unclaimed.size(); ++i)
+        result += (i == 0 ? " " : ", ") + this->DescribeUnknown(unclaimed[i].second);
+    } else {
+      result = this->CheckNonFlagCount();
+    }
+
+    _fingerprint = this->ComputeFingerprint();
+    _usage_stale = true;
+    this->Report(result, false);
+    return result.empty();
+  }
+
+ private:
+  // Cold per-flag data: names, descriptions, fallbacks and choices
+  std::vector<Argument> _required;
+  std::vector<Argument> _optional;
+  // Hot lookup data, one entry per registered flag or alias in parallel arrays. Parsing classifies
+  // tokens with the hashes and traits and only touches the Arguments above for matches.
+  enum : uint8_t { kTraitRequired = 1, kTraitValue = 2, kTraitFallback = 4 };
+  std::vector<uint64_t> _name_hashes;
+  std::vector<uint8_t> _name_traits;
+  std::vector<uint32_t> _name_arguments;  // Index into _required or _optional, per kTraitRequired
+  // Entry i spans [i, i + 1) of _name_buffer
+  std::vector<uint32_t> _name_offsets = std::vector<uint32_t>(1, 0);
+  std::string _name_buffer;
+  uint32_t _short_names[256] = {};  // Entry + 1 of each single character alias, or 0
+  std::map<std::string, std::string> _arguments;
+  std::vector<std::pair<Name, Name>> _index;  // Registered flags, sorted for namespace lookups, and aliases
+  std::map<std::string, uint64_t> _decoded;
+  std::map<std::string, FlatMap> _maps;
+  std::map<std::string, ByteBuffer> _bytes;
+  std::map<std::string, std::string> _accumulating;  // Map flags and aliases to the flag their values join
+  Sweep _sweep;
+  std::map<std::string, PinnedValue> _pinned;
+  std::unordered_map<std::string, PendingFlag> _pending;
+  size_t _required_bound = 0;
+  size_t _optional_bound = 0;
+  std::vector<std::function<void(const Args&)>> _initialize_hooks;
+  std::shared_ptr<AsyncState> _async;
+  std::set<std::string> _non_semantic;
+  uint64_t _fingerprint = 0;
+  std::vector<std::string> _nonflags;
+  std::vector<int> _nonflag_positions;
+  std::string _binary;
+  std::string _error;
+  std::vector<bool> _name_specified;  // Per name entry, given on the command line
+  std::shared_ptr<ReadCounters> _reads;  // Per flag and alias, with SARGS_COUNT_READS
+  InitializeTimings _timings;
+  std::string _descriptions;
+  mutable std::string _flag_description;
+  std::string _epilogue;
+  mutable std::string _preamble;
+  mutable bool _usage_stale = true;
+  mutable CopyableMutex _usage_mutex;  // Const readers render usage and the help index on first use
+  mutable CopyableMutex _state_mutex;  // Held while registration and Initialize() change what Inspect() reads
+  std::vector<std::string> _groups = { "" };
+  uint32_t _group = 0;
+  std::string _help_filter;
+  bool _missing_required = false;  // The parse error is a missing required flag, which filtered help ignores
+  mutable std::string _help_index;  // Lowercase flag, alias and description of each argument
+  mutable std::vector<size_t> _help_offsets;  // Start of each argument in _help_index, required first
+  bool _custom_flag_description = false;
+  bool _custom_preamble = false;
+  bool _frozen = false;
+  size_t _nonflags_required = 0;
+  bool _help_enabled = true;
+  bool _exit_enabled = true;
+  bool _exceptions_enabled = true;
+  bool _usage_enabled = true;
+  bool _permissive = false;
+  bool _hardened = false;
+  ParseLimits _limits;
+  size_t _steps = 0;
+  std::vector<size_t> _repetitions;  // Per Argument, required ones first
+  unsigned _desc_start = 30;
+  unsigned _desc_width = 50;
+
+  friend class ScopedArgs;
+
+  // Innermost ScopedArgs of this thread. Constant initialized, so reading it needs no guard
+  static Args*& Scoped() {
+    static thread_local Args* scoped = nullptr;
+    return scoped;
+  }
+
+  // The InitializeAsync() whose worker or report runs on this thread. Its own reads must not wait for
+  // it, while reads of any other pending instance still do.
+  static const AsyncState*& Initializing() {
+    static thread_local const AsyncState* initializing = nullptr;
+    return initializing;
+  }
+
+  struct InitializingScope {
+    explicit InitializingScope(const AsyncState* state) : previous(Initializing()) {
+      Initializing() = state;
+    }
+
+    ~InitializingScope() {
+      Initializing() = previous;
+    }
+
+    const AsyncState* previous;
+  };
+
+  // The InitializeAsync() of this instance if it runs on this thread, which defers its report
+  AsyncState* Deferring() const {
+    return (_async && Initializing() == _async.get()) ? _async.get() : nullptr;
+  }
+
+  // Cheap once ready: a null check, or an acquire load while an InitializeAsync() may be running
+  void WaitUntilReady() const {
+    if (_async && !_async->ready.load(std::memory_order_acquire) && Initializing() != _async.get())
+      _async->future.get();
+  }
+
+  void Accumulate(const std::string& flag, const std::string& alias) {
+    const std::string& canonical = flag.empty() ? alias : flag;
+    if (!flag.empty())
+      _accumulating[flag] = canonical;
+    if (!alias.empty())
+      _accumulating[alias] = canonical;
+  }
+
+  // Records a flag's value. Repeated map flags join their entries instead of replacing them
+  void StoreValue(const std::string& flag, const std::string& value) {
+    auto iter = _accumulating.find(flag);
+    if (iter == _accumulating.end()) {
+      _arguments[flag] = value;
+      return;
+    }
+
+    std::string& joined = _arguments[iter->second];
+    if (!joined.empty() && !value.empty())
+      joined += ',';
+    joined += value;
+  }
+
+  template <typename... Params>
+  void Register(std::vector<Argument>& arguments, const std::string& flag, const std::string& alias,
+                const DescriptionText& description, Params&&... params) {
+    std::lock_guard<std::mutex> lock(_state_mutex.mutex);
+    arguments.emplace_back(flag, alias, std::forward<Params>(params)...);
+    arguments.back().group = _group;
+    _help_offsets.clear();
+    const Argument& argument = arguments.back();
+    const uint8_t traits = (&arguments == &_required ? kTraitRequired : 0) |
+      (argument.value ? kTraitValue : 0) | (argument.fallback.empty() ? 0 : kTraitFallback);
+    this->AddName(flag, traits, arguments.size() - 1);
+    this->AddName(alias, traits, arguments.size() - 1);
+    auto index_iter = std::lower_bound(_index.begin(), _index.end(), flag, IndexLess);
+    if (index_iter != _index.end() && index_iter->first == flag)
+      index_iter->second = arguments.back().alias;
+    else
+      _index.emplace(index_iter, arguments.back().flag, arguments.back().alias);
+    _usage_stale = true;
+    if (_frozen)
+      return;
+
+    arguments.back().description_size = static_cast<uint32_t>(description.Size());
+    if (description.IsLiteral()) {
+      arguments.back().description_literal = description.Data();
+      return;
+    }
+    arguments.back().description_offset = static_cast<uint32_t>(_descriptions.size());
+    _descriptions.append(description.Data(), description.Size());
+  }
+
+  void AddName(const std::string& name, const uint8_t traits, const size_t argument) {
+    if (name.empty())
+      return;
+    _name_hashes.push_back(HashBytes(name.data(), name.size()));
+    _name_traits.push_back(traits);
+    _name_arguments.push_back(static_cast<uint32_t>(argument));
+    _name_buffer += name;
+    _name_offsets.push_back(static_cast<uint32_t>(_name_buffer.size()));
+    if (IsShortName(name) && _short_names[static_cast<uint8_t>(name[1])] == 0)
+      _short_names[static_cast<uint8_t>(name[1])] = static_cast<uint32_t>(_name_hashes.size());
+  }
+
+  static bool IsShortName(const std::string& name) {
+    return name.size() == 2 && name[0] == '-' && name[1] != '-';
+  }
+
+  // Returns the entry of a registered flag or alias, or -1. The scan reads 8 bytes per name and
+  // only compares the characters on a hash match.
+  int FindName(const std::string& name) const {
+    if (name.empty())
+      return -1;
+    if (IsShortName(name))
+      return static_cast<int>(_short_names[static_cast<uint8_t>(name[1])]) - 1;
+    const uint64_t hash = HashBytes(name.data(), name.size());
+    for (size_t i = 0; i < _name_hashes.size(); ++i) {
+      if (_name_hashes[i] == hash &&
+          _name_buffer.compare(_name_offsets[i], _name_offsets[i + 1] - _name_offsets[i], name) == 0)
+        return static_cast<int>(i);
+    }
+    return -1;
+  }
+
+  const Argument& ArgumentOf(const int entry) const {
+    const std::vector<Argument>& arguments = (_name_traits[entry] & kTraitRequired) ? _required : _optional;
+    return arguments[_name_arguments[entry]];
+  }
+
+  Argument& ArgumentOf(const int entry) {
+    std::vector<Argument>& arguments = (_name_traits[entry] & kTraitRequired) ? _required : _optional;
+    return arguments[_name_arguments[entry]];
+  }
+
+  static bool IndexLess(const std::pair<Name, Name>& entry, const std::string& flag) {
+    return entry.first.Text() < flag;
+  }
+
+  template <typename Map>
+  static size_t MapBytes(const Map& map) {
+    size_t bytes = 0;
+    for (const auto& iter : map)
+      bytes += sizeof(iter) + 4 * sizeof(void*) + HeapBytes(iter.first);
+    return bytes;
+  }
+
+  static size_t StringMapBytes(const std::map<std::string, std::string>& map) {
+    size_t bytes = MapBytes(map);
+    for (const auto& iter : map)
+      bytes += HeapBytes(iter.second);
+    return bytes;
+  }
+
+  static size_t RegistryBytes(const std::vector<Argument>& arguments) {
+    size_t bytes = arguments.capacity() * sizeof(Argument);
+    for (const auto& argument : arguments)
+      bytes += HeapBytes(argument.fallback) + argument.choices.MemoryUsage() +
+        (argument.pattern ? sizeof(Pattern) + argument.pattern->MemoryUsage() : 0);
+    return bytes;
+  }
+
+  std::string Description(const Argument& argument) const {
+    if (_frozen)
+      return "";
+    if (argument.description_literal != nullptr)
+      return std::string(argument.description_literal, argument.description_size);
+    return _descriptions.substr(argument.description_offset, argument.description_size);
+  }
+
+  void Initialize(TokenizedArgv& tokens, const bool shared) {
+    if (_help_enabled)
+      this->AddOptionalFlag("--help", "-h", "Print usage and options information");
+    if (!shared && !_hardened && this->AnswerFromSchema(tokens))
+      return;
+
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point start = Clock::now();
+    std::unique_lock<std::mutex> lock(_state_mutex.mutex);
+    std::string result = tokens.Error();
+    if (result.empty())
+      result = this->Parse(tokens, shared);
+    _name_specified.clear();
+    this->MarkSpecified();
+    const Clock::time_point parsed = Clock::now();
+    this->AddFallbackValues();
+    const Clock::time_point filled = Clock::now();
+    if (result.empty())
+      result = this->DecodeValues();
+    const Clock::time_point decoded = Clock::now();
+
+    _fingerprint = this->ComputeFingerprint();
+    const Clock::time_point hashed = Clock::now();
+    _usage_stale = true;
+#ifdef SARGS_COUNT_READS
+    std::shared_ptr<ReadCounters> reads(new ReadCounters(_name_hashes.size()));
+    for (size_t i = 0; i < _name_hashes.size(); ++i) {
+      std::string name(_name_buffer, _name_offsets[i], _name_offsets[i + 1] - _name_offsets[i]);
+      reads->emplace(std::piecewise_construct, std::forward_as_tuple(std::move(name)), std::forward_as_tuple(0));
+    }
+    _reads = reads;
+#endif
+    lock.unlock();
+    const bool help_specified = _arguments.count("--help") > 0 || _arguments.count("-h") > 0;
+    const bool help = _help_enabled && help_specified;
+    if (AsyncState* deferring = this->Deferring()) {
+      // Reported when the future is consumed. Hooks are skipped if that exits, as after Report()
+      _error = result;
+      deferring->help = help;
+      if (_exit_enabled && (help || !result.empty()))
+        return;
+    } else {
+      this->Report(result, help);
+    }
+
+    for (const auto& hook : _initialize_hooks)
+      hook(*this);
+
+    const Clock::time_point done = Clock::now();
+    lock.lock();
+    _timings.parse = Nanoseconds(start, parsed);
+    _timings.fallbacks = Nanoseconds(parsed, filled);
+    _timings.decode = Nanoseconds(filled, decoded);
+    _timings.fingerprint = Nanoseconds(decoded, hashed);
+    _timings.hooks = Nanoseconds(hashed, done);
+    _timings.total = Nanoseconds(start, done);
+    ++_timings.count;
   }
 
-  std::string GetPreamble() const {
-    return _preamble;
+  static uint64_t Nanoseconds(const std::chrono::steady_clock::time_point& start,
+                              const std::chrono::steady_clock::time_point& stop) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
   }
 
-  std::string GetEpilogue() const {
-    return _epilogue;
+  // Records which names were given on the command line, before fallbacks fill in the rest.
+  // Names registered since the last call are the only ones visited.
+  void MarkSpecified() {
+    for (size_t i = _name_specified.size(); i < _name_hashes.size(); ++i) {
+      const std::string name(_name_buffer, _name_offsets[i], _name_offsets[i + 1] - _name_offsets[i]);
+      _name_specified.push_back(_arguments.count(name) > 0 && this->FindPinned(name) == _pinned.end());
+    }
   }
 
-  std::string GetFlagDescription() const {
-    return _flag_description;
+  // Compiled out unless SARGS_COUNT_READS is defined, so getters pay nothing for it by default
+  void CountRead(const std::string& flag) const {
+#ifdef SARGS_COUNT_READS
+    if (!_reads)
+      return;
+    auto iter = _reads->find(flag);
+    if (iter != _reads->end())
+      iter->second.fetch_add(1, std::memory_order_relaxed);
+#else
+    (void) flag;
+#endif
   }
 
-  std::string GetBinary() const {
-    return _binary;
-  }
+  // Handles the hidden --sargs-complete <index> <words...>, --sargs-complete-script <shell> and
+  // --sargs-dump-schema arguments from the schema alone, before anything is parsed, and exits
+  bool AnswerFromSchema(const TokenizedArgv& tokens) {
+    const std::vector<Token>& list = tokens.Tokens();
+    if (list.empty() || (list[0].text != "--sargs-complete" && list[0].text != "--sargs-complete-script" &&
+                         list[0].text != "--sargs-dump-schema"))
+      return false;
 
-  void Initialize(int argc, char* argv[]) {
-    if (_help_enabled)
-      this->AddOptionalFlag("--help", "-h", "Print usage and options information");
+    _binary = tokens.Binary();
+    if (list[0].text == "--sargs-dump-schema") {
+      std::cout << this->Schema();
+    } else if (list[0].text == "--sargs-complete-script") {
+      std::cout << this->CompletionScript(list.size() > 1 ? list[1].text : "bash");
+    } else {
+      uint64_t index = 0;
+      std::vector<std::string> words;
+      for (size_t i = 2; i < list.size(); ++i)
+        words.push_back(list[i].text);
+      if (list.size() > 1 && ConvertToUInt64(list[1].text, index)) {
+        for (const auto& candidate : this->Complete(words, static_cast<size_t>(index)))
+          std::cout << candidate << '\n';
+      }
+    }
+    std::cout.flush();
 
-    std::string result = this->Parse(argc, argv);
-    this->GenerateUsage();
-    const bool help_specified = this->Has("--help") || this->Has("-h");
-    const bool usage = (_help_enabled && help_specified) || !result.empty();
+    if (AsyncState* deferring = this->Deferring())
+      deferring->answered = true;
+    else if (_exit_enabled)
+      exit(0);
+    return true;
+  }
 
+  void Report(const std::string& result, const bool help) {
+    _error = result;
+    const bool usage = help || !result.empty();
+    // Filtered help is for finding a flag, so it is printed even if required flags are missing. Any
+    // other error is reported with the full usage.
+    const bool filtered = help && !_help_filter.empty() && (result.empty() || _missing_required);
     if (usage) {
-      if (_usage_enabled) {
+      if (_usage_enabled && filtered) {
+        this->PrintUsage(std::cout, _help_filter);
+      } else if (_usage_enabled) {
         this->PrintUsage(std::cout);
         if (!result.empty())
           std::cout << "\nError: " << result << "\n"  << std::endl;
       }
 
       if (_exit_enabled) {
-        if (result.empty())
+        if (result.empty() || filtered)
           exit(0);
         else
           exit(1);
       }
     }
+  }
 
-    this->AddFallbackValues();
+  void AddNonFlag(const std::string& nonflag, const int position) {
+    auto iter = std::upper_bound(_nonflag_positions.begin(), _nonflag_positions.end(), position);
+    _nonflags.insert(_nonflags.begin() + (iter - _nonflag_positions.begin()), nonflag);
+    _nonflag_positions.insert(iter, position);
   }
 
- private:
-  std::vector<Argument> _required;
-  std::vector<Argument> _optional;
-  std::map<std::string, std::string> _arguments;
-  std::vector<std::string> _nonflags;
-  std::string _binary;
-  std::string _flag_description;
-  std::string _epilogue;
-  std::string _preamble;
-  size_t _nonflags_required = 0;
-  bool _help_enabled = true;
-  bool _exit_enabled = true;
-  bool _exceptions_enabled = true;
-  bool _usage_enabled = true;
-  unsigned _desc_start = 30;
-  unsigned _desc_width = 50;
+  // Returns true if the following token was held as the flag's possible value
+  bool AddPending(const Token& token, const int position, const Token* next) {
+    PendingFlag pending;
+    pending.position = position;
+    pending.has_value = token.has_value;
+    if (pending.has_value) {
+      pending.value = token.value;
+    } else if (next != nullptr && !next->flag) {
+      pending.has_next = true;
+      pending.next = next->text;
+    }
 
-  bool CheckIfNonValueFlag(const std::string& flag) const {
-    for (auto iter : _required) {
-      if (flag == iter.flag || flag == iter.alias)
-        return !iter.value;
+    // The last occurrence wins, as for registered flags
+    auto iter = _pending.find(token.name);
+    if (iter != _pending.end() && iter->second.has_next)
+      this->AddNonFlag(iter->second.next, iter->second.position + 1);
+    _pending[token.name] = pending;
+    return pending.has_next;
+  }
+
+  std::string Claim(const std::vector<Argument>& to_claim) {
+    for (const auto& iter : to_claim) {
+      auto pending_iter = _pending.find(iter.flag);
+      if (pending_iter == _pending.end() && !iter.alias.Empty())
+        pending_iter = _pending.find(iter.alias);
+      if (pending_iter == _pending.end())
+        continue;
+
+      const PendingFlag& pending = pending_iter->second;
+      if (!iter.value && pending.has_value)
+        continue;
+
+      if (iter.value) {
+        if (!pending.has_value && !pending.has_next)
+          return "Must set value for " + pending_iter->first;
+        this->StoreValue(pending_iter->first, pending.has_value ? pending.value : pending.next);
+      } else {
+        _arguments[pending_iter->first] = "";
+        if (pending.has_next)
+          this->AddNonFlag(pending.next, pending.position + 1);
+      }
+      _pending.erase(pending_iter);
     }
+    return "";
+  }
 
-    for (auto iter : _optional) {
-      if (flag == iter.flag || flag == iter.alias)
-        return !iter.value;
+  std::string CheckNonFlagCount() const {
+    if (_nonflags.size() == _nonflags_required)
+      return "";
+    std::string result = "Unknown arguments";
+    if (_nonflags_required > 0)
+      result += " or user must specify " + std::to_string(_nonflags_required) + " non-flags";
+
+    // Name the arguments that look like misspelled flags
+    const size_t shown = 8;
+    size_t unknown = 0;
+    for (const auto& nonflag : _nonflags) {
+      if (nonflag.size() < 2 || nonflag[0] != '-')
+        continue;
+      if (unknown < shown)
+        result += (unknown == 0 ? ": " : ", ") + this->DescribeUnknown(nonflag);
+      ++unknown;
     }
+    if (unknown > shown)
+      result += " and " + std::to_string(unknown - shown) + " more";
+    return result;
+  }
 
-    return false;
+  std::string DescribeUnknown(const std::string& token) const {
+    const std::vector<std::string> suggestions = this->Suggestions(token);
+    if (suggestions.empty())
+      return token;
+    std::string description = token + " (did you mean ";
+    for (size_t i = 0; i < suggestions.size(); ++i)
+      description += (i == 0 ? "" : i + 1 == suggestions.size() ? " or " : ", ") + suggestions[i];
+    return description + "?)";
   }
 
-  bool CheckIfValueFlag(const std::string& flag) const {
-    for (auto iter : _required) {
-      if (flag == iter.flag || flag == iter.alias)
-        return iter.value;
-    }
+  std::vector<Choice> NumberChoices(const std::vector<std::string>& names) const {
+    if (names.size() > 64)
+      throw SargsError("Set flags support at most 64 choices");
 
-    for (auto iter : _optional) {
-      if (flag == iter.flag || flag == iter.alias)
-        return iter.value;
-    }
+    std::vector<Choice> choices;
+    for (size_t i = 0; i < names.size(); ++i)
+      choices.emplace_back(names[i], i);
+    return choices;
+  }
 
-    return false;
+  bool CheckIfNonValueFlag(const std::string& flag) const {
+    const int entry = this->FindName(flag);
+    return entry >= 0 && (_name_traits[entry] & kTraitValue) == 0;
+  }
+
+  bool CheckIfValueFlag(const std::string& flag) const {
+    const int entry = this->FindName(flag);
+    return entry >= 0 && (_name_traits[entry] & kTraitValue) != 0;
   }
 
   std::string CheckForMissing(const std::vector<Argument>& to_check) {
-    for (auto iter : to_check) {
+    for (const auto& iter : to_check) {
       auto flag_iter = _arguments.find(iter.flag);
       auto alias_iter = _arguments.find(iter.alias);
       if (flag_iter == _arguments.end() && alias_iter == _arguments.end()) {
         std::stringstream err;
-        if (!iter.flag.empty())
-          err << "Must specify " + iter.flag;
+        if (!iter.flag.Empty())
+          err << "Must specify " << iter.flag;
         else
-          err << "Must specify " + iter.alias;
+          err << "Must specify " << iter.alias;
         return err.str();
       }
     }
@@ -520,12 +3294,12 @@ class Args {
   }
 
   std::string CheckForValues(const std::vector<Argument>& to_check) {
-    for (auto iter : to_check) {
+    for (const auto& iter : to_check) {
       auto arg_iter = _arguments.find(iter.flag);
-      if (arg_iter != _arguments.end() && !iter.alias.empty()) {
+      if (arg_iter != _arguments.end() && !iter.alias.Empty()) {
         if (iter.value && arg_iter->second.empty()) {
           std::stringstream err;
-          err << "Must specify value for " + iter.flag;
+          err << "Must specify value for " << iter.flag;
           return err.str();
         }
 
@@ -537,7 +3311,7 @@ class Args {
       if (arg_iter != _arguments.end() && !arg_iter->second.empty()) {
         if (iter.value && arg_iter->second.empty()) {
           std::stringstream err;
-          err << "Must specify value for " + iter.alias;
+          err << "Must specify value for " << iter.alias;
           return err.str();
         }
 
@@ -548,31 +3322,218 @@ class Args {
     return "";
   }
 
-  bool TryFlagValueSplit(const std::string& arg, std::pair<std::string, std::string>& flag_value) {
-    size_t pos = arg.find_first_of('=');
-    std::string current_flag(arg.substr(0, pos));
-    const bool has_separator = (pos != std::string::npos);
-    const bool is_expected = this->CheckIfValueFlag(current_flag);
-    if (has_separator && is_expected) {
-      flag_value.first = current_flag;
-      flag_value.second = arg.substr(pos + 1);
+  bool DecodeChoice(const Argument& argument, const std::string& value, uint64_t& decoded) const {
+    int64_t choice = 0;
+    if (argument.kind == ArgumentKind::kEnum) {
+      if (!argument.choices.Find(value, choice))
+        return false;
+      decoded = static_cast<uint64_t>(choice);
       return true;
     }
-    return false;
+
+    decoded = 0;
+    size_t start = 0;
+    while (start <= value.size()) {
+      size_t end = value.find(',', start);
+      if (end == std::string::npos)
+        end = value.size();
+      if (!argument.choices.Find(value.substr(start, end - start), choice))
+        return false;
+      decoded |= (1ULL << choice);
+      start = end + 1;
+    }
+    return true;
   }
 
-  void AddFallbackValues() {
-    for (auto iter : _optional) {
-      auto flag_iter = _arguments.find(iter.flag);
-      if (flag_iter == _arguments.end() && !iter.fallback.empty())
-        _arguments[iter.flag] = iter.fallback;
+  static std::string Mismatch(const std::string& name, const Pattern& pattern, const std::string& value) {
+    return "Invalid value for " + name + ": " + value + " does not match " + pattern.Expression();
+  }
 
-      auto alias_iter = _arguments.find(iter.alias);
-      if (alias_iter == _arguments.end() && !iter.fallback.empty())
-        _arguments[iter.alias] = iter.fallback;
+  std::string DecodeValues(const std::vector<Argument>& to_decode) {
+    for (const auto& iter : to_decode) {
+      if (iter.kind == ArgumentKind::kPlain && !iter.pattern)
+        continue;
+
+      const std::string& name = iter.flag.Empty() ? iter.alias : iter.flag;
+      auto arg_iter = _arguments.find(name);
+      if (arg_iter == _arguments.end())
+        continue;
+
+      if (iter.kind == ArgumentKind::kPlain) {
+        if (!iter.pattern->Matches(arg_iter->second))
+          return Mismatch(name, *iter.pattern, arg_iter->second);
+        continue;
+      }
+
+      if (iter.kind == ArgumentKind::kMap) {
+        FlatMap decoded;
+        std::string invalid;
+        if (!this->Step(std::count(arg_iter->second.begin(), arg_iter->second.end(), ',') + 1))
+          return this->StepError();
+        if (!decoded.Decode(arg_iter->second, invalid))
+          return "Invalid entry for " + name + ": " + invalid;
+        for (const auto& item : decoded.Items()) {
+          if (iter.pattern && !iter.pattern->Matches(item.second.data, item.second.size))
+            return Mismatch(name, *iter.pattern, item.second.ToString());
+        }
+        _maps[name] = decoded;
+        continue;
+      }
+
+      if (iter.kind == ArgumentKind::kHex || iter.kind == ArgumentKind::kBase64) {
+        ByteBuffer decoded;
+        const size_t invalid = decoded.Decode(iter.kind, arg_iter->second);
+        if (invalid != std::string::npos)
+          return std::string("Invalid ") + KindName(iter.kind) + " for " + name + " at offset " +
+                 std::to_string(invalid);
+        _bytes[name] = std::move(decoded);
+        continue;
+      }
+
+      if (iter.kind == ArgumentKind::kNumber) {
+        std::string normalized;
+        if (!NormalizeNumber(arg_iter->second, normalized))
+          return "Invalid number for " + name + ": " + arg_iter->second;
+        continue;
+      }
+
+      if (iter.kind == ArgumentKind::kSweep) {
+        Sweep::Dimension dimension;
+        if (!Sweep::Parse(arg_iter->second, dimension))
+          return "Invalid sweep for " + name + ": " + arg_iter->second;
+        // Lists cost their values and ranges are free unless every value must match a pattern
+        const bool lazy = dimension.values.empty() && !iter.pattern;
+        if (!this->Step(lazy ? 1 : dimension.Size()))
+          return this->StepError();
+        if (iter.pattern && dimension.Size() > Sweep::kMaxPatternValues)
+          return "Invalid sweep for " + name + ": more than " + std::to_string(Sweep::kMaxPatternValues) +
+                 " values to match against " + iter.pattern->Expression();
+        for (size_t i = 0; iter.pattern && i < dimension.Size(); ++i) {
+          const std::string value(dimension.Value(i));
+          if (!iter.pattern->Matches(value))
+            return Mismatch(name, *iter.pattern, value);
+        }
+        dimension.flag = iter.flag;
+        dimension.alias = iter.alias;
+        if (!_sweep.AddDimension(dimension))
+          return "Invalid sweep for " + name + ": the sweep has more than " +
+                 std::to_string(std::numeric_limits<size_t>::max()) + " points";
+        continue;
+      }
+
+      uint64_t decoded = 0;
+      if (!this->Step(std::count(arg_iter->second.begin(), arg_iter->second.end(), ',') + 1))
+        return this->StepError();
+      if (!this->DecodeChoice(iter, arg_iter->second, decoded))
+        return "Invalid value for " + name + ": " + arg_iter->second;
+
+      if (!iter.flag.Empty())
+        _decoded[iter.flag] = decoded;
+      if (!iter.alias.Empty())
+        _decoded[iter.alias] = decoded;
+    }
+    return "";
+  }
+
+  std::string DecodeValues() {
+    _decoded.clear();
+    _maps.clear();
+    _bytes.clear();
+    _sweep = Sweep();
+    std::string result = this->DecodeValues(_required);
+    if (result.empty())
+      result = this->DecodeValues(_optional);
+    return result;
+  }
+
+  std::map<std::string, PinnedValue>::const_iterator FindPinned(const std::string& flag) const {
+    if (_pinned.empty() || flag.empty())
+      return _pinned.end();
+
+    auto iter = _pinned.find(flag);
+    if (iter == _pinned.end())
+      iter = _pinned.find(this->FindAlternative(flag));
+    return iter;
+  }
+
+  void ApplyPinned() {
+    for (const auto& iter : _pinned) {
+      if (iter.second.present)
+        _arguments[iter.first] = iter.second.value;
+    }
+  }
+
+  static std::string ToString(const ByteSpan bytes) {
+    return std::string(reinterpret_cast<const char*>(bytes.data), bytes.size);
+  }
+
+  // Spells a number the same way whatever its notation. Returns false if value is not a number.
+  static bool NormalizeNumber(const std::string& value, std::string& normalized) {
+    if (value.empty())
+      return false;
+
+    char* end = nullptr;
+    errno = 0;
+    const long long integer = std::strtoll(value.c_str(), &end, 0);
+    if (*end == '\0' && errno != ERANGE) {
+      normalized = std::to_string(integer);
+      return true;
+    }
+
+    errno = 0;
+    const double real = std::strtod(value.c_str(), &end);
+    if (*end != '\0' || errno == ERANGE)
+      return false;
+    std::stringstream stream;
+    stream << std::setprecision(17) << real;
+    normalized = stream.str();
+    return true;
+  }
+
+  uint64_t ComputeFingerprint() const {
+    std::map<std::string, std::string> canonical;
+    for (const std::vector<Argument>* arguments : { &_required, &_optional }) {
+      for (const auto& iter : *arguments) {
+        const std::string& name = iter.flag.Empty() ? iter.alias : iter.flag;
+        if (name == "--help" || _non_semantic.count(iter.flag) > 0 || _non_semantic.count(iter.alias) > 0)
+          continue;
+
+        auto arg_iter = _arguments.find(name);
+        if (arg_iter == _arguments.end() && !iter.alias.Empty())
+          arg_iter = _arguments.find(iter.alias);
+        if (arg_iter == _arguments.end())
+          continue;
+
+        // Only values with a decoded form are compared by meaning, everything else byte for byte
+        auto decoded_iter = _decoded.find(name);
+        auto bytes_iter = _bytes.find(name);
+        std::string& value = canonical[name];
+        if (decoded_iter != _decoded.end())
+          value = std::to_string(decoded_iter->second);
+        else if (bytes_iter != _bytes.end())
+          value = std::to_string(bytes_iter->second.Bytes().size) + ':' + ToString(bytes_iter->second.Bytes());
+        else if (iter.kind != ArgumentKind::kNumber || !NormalizeNumber(arg_iter->second, value))
+          value = arg_iter->second;
+      }
+    }
+
+    std::string serialized;
+    for (const auto& iter : canonical) {
+      serialized += iter.first;
+      serialized += '\0';
+      serialized += iter.second;
+      serialized += '\0';
     }
+    for (const auto& nonflag : _nonflags) {
+      serialized += '\1';
+      serialized += nonflag;
+      serialized += '\0';
+    }
+    return HashBytes(serialized.data(), serialized.size());
+  }
 
-    for (auto iter : _required) {
+  void AddFallbackValues(const std::vector<Argument>& arguments) {
+    for (const auto& iter : arguments) {
       auto flag_iter = _arguments.find(iter.flag);
       if (flag_iter == _arguments.end() && !iter.fallback.empty())
         _arguments[iter.flag] = iter.fallback;
@@ -583,37 +3544,171 @@ class Args {
     }
   }
 
-  std::string Parse(int argc, char* argv[]) {
-    _binary = argv[0];
-    const int total_flags = _required.size() + _optional.size();
+  // Only names whose traits say they have a fallback read their Argument
+  void AddFallbackValues() {
+    for (size_t i = 0; i < _name_traits.size(); ++i) {
+      if ((_name_traits[i] & kTraitFallback) == 0)
+        continue;
+      const std::string name(_name_buffer, _name_offsets[i], _name_offsets[i + 1] - _name_offsets[i]);
+      if (_arguments.find(name) == _arguments.end())
+        _arguments[name] = this->ArgumentOf(static_cast<int>(i)).fallback;
+    }
+  }
+
+  // Sets the flags of a cluster of single character aliases and returns how many were set, or 0 if
+  // the token isn't made of registered aliases. Each character is one table lookup. A value flag
+  // ends the cluster and takes the rest of the token, or the next argument if nothing is left.
+  int ParseCluster(const std::vector<Token>& list, const size_t i, bool& used_next, std::string& error) {
+    const std::string& text = list[i].text;
+    if (text.size() < 3 || text[0] != '-' || text[1] == '-')
+      return 0;
+    if (!this->Step(text.size())) {
+      error = this->StepError();
+      return 0;
+    }
+
+    for (size_t j = 1; j < text.size(); ++j) {
+      const uint32_t entry = _short_names[static_cast<uint8_t>(text[j])];
+      if (entry == 0)
+        return 0;
+      const std::string alias{'-', text[j]};
+      if (this->FindPinned(alias) != _pinned.end()) {
+        error = alias + " is pinned at build time and cannot be overridden";
+        return 0;
+      }
+      if ((_name_traits[entry - 1] & kTraitValue) == 0)
+        continue;
+      if (j + 1 == text.size() && i + 1 == list.size()) {
+        error = "Must set value for " + alias;
+        return 0;
+      }
+      break;
+    }
+
+    int count = 0;
+    for (size_t j = 1; j < text.size(); ++j) {
+      const std::string alias{'-', text[j]};
+      ++count;
+      error = this->Repeat(alias);
+      if (!error.empty())
+        return count;
+      if ((_name_traits[_short_names[static_cast<uint8_t>(text[j])] - 1] & kTraitValue) == 0) {
+        _arguments[alias] = "";
+        continue;
+      }
+
+      std::string value(text.substr(j + 1));
+      if (!value.empty() && value[0] == '=') {
+        value.erase(0, 1);
+      } else if (value.empty()) {
+        value = list[i + 1].text;
+        used_next = true;
+      }
+      this->StoreValue(alias, value);
+      break;
+    }
+    return count;
+  }
+
+  // Charges work against the step budget and returns false once it is exhausted
+  bool Step(const size_t steps = 1) {
+    _steps += steps;
+    return _limits.max_steps == 0 || _steps <= _limits.max_steps;
+  }
+
+  std::string StepError() const {
+    return "Exceeded the limit of " + std::to_string(_limits.max_steps) + " parse steps";
+  }
+
+  // Counts an occurrence of a registered flag and returns an error once it repeats too often
+  std::string Repeat(const std::string& name) {
+    if (_limits.max_repetitions == 0)
+      return "";
+    const int entry = this->FindName(name);
+    if (entry < 0)
+      return "";
+    const bool required = (_name_traits[entry] & kTraitRequired) != 0;
+    const size_t slot = (required ? 0 : _required.size()) + _name_arguments[entry];
+    if (slot >= _repetitions.size())
+      _repetitions.resize(_required.size() + _optional.size(), 0);
+    if (++_repetitions[slot] <= _limits.max_repetitions)
+      return "";
+    return name + " is repeated more than " + std::to_string(_limits.max_repetitions) + " times";
+  }
+
+  std::string Parse(TokenizedArgv& tokens, const bool shared) {
+    _binary = tokens.Binary();
+    _pending.clear();
+    _steps = 0;
+    _repetitions.clear();
+    _help_filter.clear();
+    _missing_required = false;
+    _required_bound = _required.size();
+    _optional_bound = _optional.size();
+    // Once every registered flag was seen the rest are non-flags, unless late registrations may follow
+    const bool open_ended = _permissive || shared;
+    const int total_flags = open_ended ? std::numeric_limits<int>::max() : _required.size() + _optional.size();
+    const std::vector<Token>& list = tokens.Tokens();
     int flags_encountered = 0;
     bool delim_encountered = false;
-    for (int i = 1; i < argc; ++i) {
+    for (size_t i = 0; i < list.size(); ++i) {
+      if (!this->Step())
+        return this->StepError();
+
       // Check if we encountered the non-flag delimiter
-      const std::string current(argv[i]);
-      if (current == std::string("--")) {
+      const Token& token = list[i];
+      const int position = static_cast<int>(i) + 1;
+      if (token.text == "--") {
         delim_encountered = true;
+        tokens.Claim(i);
         continue;
       }
 
-      // Check for explicit non-flags
+      // Check for explicit non-flags. Shared tokens after the delimiter belong to whoever requires them
       if (delim_encountered) {
-        _nonflags.push_back(argv[i]);
+        if (!shared || _nonflags_required > 0) {
+          tokens.Claim(i);
+          this->AddNonFlag(token.text, position);
+        }
         continue;
       }
 
-      if (this->CheckIfNonValueFlag(current)) {
-        _arguments[current] = "";
+      auto pinned_iter = this->FindPinned(token.name);
+      if (pinned_iter != _pinned.end()) {
+        if (!pinned_iter->second.present)
+          return token.name + " is disabled at build time and cannot be specified";
+        return token.name + " is pinned at build time and cannot be overridden";
+      }
+
+      // --help=<group|substring> prints part of the usage
+      if (token.has_value && _help_enabled && (token.name == "--help" || token.name == "-h")) {
+        _arguments[token.name] = "";
+        _help_filter = token.value;
+        tokens.Claim(i);
+        continue;
+      }
+
+      if (this->CheckIfNonValueFlag(token.text)) {
+        std::string error = this->Repeat(token.text);
+        if (!error.empty())
+          return error;
+        _arguments[token.text] = "";
+        tokens.Claim(i);
         ++flags_encountered;
         if (flags_encountered >= total_flags)
           delim_encountered = true;
         continue;
       }
 
-      if (this->CheckIfValueFlag(current)) {
-        if (i + 1 == argc)
-          return "Must set value for " + current;
-        _arguments[current] = argv[i + 1];
+      if (this->CheckIfValueFlag(token.text)) {
+        if (i + 1 == list.size())
+          return "Must set value for " + token.text;
+        std::string error = this->Repeat(token.text);
+        if (!error.empty())
+          return error;
+        this->StoreValue(token.text, list[i + 1].text);
+        tokens.Claim(i);
+        tokens.Claim(i + 1);
         i++;
         flags_encountered++;
         if (flags_encountered >= total_flags)
@@ -621,118 +3716,245 @@ class Args {
         continue;
       }
 
-      std::pair<std::string, std::string> flag_value;
-      if (this->TryFlagValueSplit(current, flag_value)) {
-        _arguments[flag_value.first] = flag_value.second;
+      if (token.has_value && this->CheckIfValueFlag(token.name)) {
+        std::string error = this->Repeat(token.name);
+        if (!error.empty())
+          return error;
+        this->StoreValue(token.name, token.value);
+        tokens.Claim(i);
         flags_encountered++;
         if (flags_encountered >= total_flags)
           delim_encountered = true;
         continue;
       }
 
+      // POSIX short option clusters and attached values, e.g. -vxf, -p2 or -vofile
+      bool used_next = false;
+      std::string error;
+      const int clustered = this->ParseCluster(list, i, used_next, error);
+      if (!error.empty())
+        return error;
+      if (clustered > 0) {
+        tokens.Claim(i);
+        if (used_next)
+          tokens.Claim(++i);
+        flags_encountered += clustered;
+        if (flags_encountered >= total_flags)
+          delim_encountered = true;
+        continue;
+      }
+
+      // Anything else in shared tokens may belong to another instance
+      if (shared)
+        continue;
+
+      // Hold unrecognized flags for a later claim in permissive mode
+      if (_permissive && token.flag) {
+        const Token* next = (i + 1 < list.size()) ? &list[i + 1] : nullptr;
+        if (this->AddPending(token, position, next))
+          ++i;
+        continue;
+      }
+
       // Otherwise set to non-flag
-      _nonflags.push_back(argv[i]);
+      this->AddNonFlag(token.text, position);
     }
 
-    if (_nonflags.size() != _nonflags_required && _nonflags_required == 0)
-      return "Unknown arguments";
-    else if (_nonflags.size() != _nonflags_required)
-      return "Unknown arguments or user must specify " + std::to_string(_nonflags_required) + " non-flags";
+    // Pending flags may still turn out to be non-flags, so the count is checked by CheckUnclaimed()
+    if (shared ? _nonflags_required > 0 : !_permissive) {
+      std::string result = this->CheckNonFlagCount();
+      if (!result.empty())
+        return result;
+    }
 
+    this->ApplyPinned();
     std::string result = this->CheckForValues(_required);
     if (result.empty())
       result = this->CheckForValues(_optional);
-    if (result.empty())
+    if (result.empty()) {
       result = this->CheckForMissing(_required);
+      _missing_required = !result.empty();
+    }
     return result;
   }
 
-  size_t DetermineNumCharsToWrite(const std::string& description) const {
-    size_t location = _desc_width - 1;
-    while (std::isalpha(description[location]) && location > 0) --location;
-    if (location == 0 && std::isalpha(description[location])) return _desc_width;
-    return location + 1;
+  // Characters of the line starting at start that end on a word boundary, or the whole width if
+  // one word fills it
+  size_t DetermineNumCharsToWrite(const std::string& description, const size_t start) const {
+    size_t location = start + _desc_width - 1;
+    while (location > start && std::isalpha(static_cast<unsigned char>(description[location]))) --location;
+    if (location == start && std::isalpha(static_cast<unsigned char>(description[location])))
+      return _desc_width;
+    return location - start + 1;
   }
 
+  // Wraps in time linear in the size of the description
   std::string FormatDescription(const std::string& description) const {
     if (description.size() <= _desc_width) return description;
     std::stringstream stream;
     size_t count = 0;
-    while (count < (description.size() - _desc_width)) {
-      size_t to_write = this->DetermineNumCharsToWrite(description.substr(count));
+    while (count < description.size() && std::isblank(static_cast<unsigned char>(description[count]))) ++count;
+    while (description.size() - count > _desc_width) {
+      const size_t to_write = this->DetermineNumCharsToWrite(description, count);
+      stream.write(&description[count], static_cast<std::streamsize>(to_write));
+      stream << "\n" << std::string(_desc_start, ' ');
+      count += to_write;
 
-      // Determine where to start writing the next line
-      size_t skip = 0;
-      while (std::isblank(description[count + skip]) && (skip < _desc_width))
-        ++skip;
+      // Don't start the next line with blanks
+      while (count < description.size() && std::isblank(static_cast<unsigned char>(description[count])))
+        ++count;
+    }
+    stream.write(description.data() + count, static_cast<std::streamsize>(description.size() - count));
+    return stream.str();
+  }
 
-      // Don't write a blank line
-      count += skip;
-      if (skip == _desc_width)
-        continue;
+  std::string DescribeArgument(const Argument& argument) const {
+    const std::string text(this->Description(argument));
+    auto pinned_iter = this->FindPinned(argument.flag.Empty() ? argument.alias : argument.flag);
+    if (argument.kind == ArgumentKind::kPlain && !argument.pattern && pinned_iter == _pinned.end())
+      return text;
+
+    std::stringstream description;
+    description << text;
+    if (!text.empty())
+      description << ' ';
+
+    if (argument.kind == ArgumentKind::kSweep) {
+      description << "(sweep: start:end[:step|:xfactor] or {a,b,...})";
+    } else if (argument.kind == ArgumentKind::kMap) {
+      description << "(key=value,... repeatable)";
+    } else if (argument.kind == ArgumentKind::kHex || argument.kind == ArgumentKind::kBase64) {
+      description << '(' << KindName(argument.kind) << " bytes)";
+    } else if (argument.kind == ArgumentKind::kNumber) {
+      description << "(number)";
+    } else if (argument.kind != ArgumentKind::kPlain) {
+      description << (argument.kind == ArgumentKind::kEnum ? "(one of: " : "(any of: ");
+      const std::vector<Choice>& choices = argument.choices.Choices();
+      for (size_t i = 0; i < choices.size(); ++i) {
+        if (i > 0)
+          description << ", ";
+        description << choices[i].name;
+      }
+      description << ')';
+    }
 
-      stream << description.substr(count, to_write) << "\n" << std::string(_desc_start, ' ');
-      count += to_write;
+    if (argument.pattern) {
+      if (argument.kind != ArgumentKind::kPlain)
+        description << ' ';
+      description << "(pattern: " << argument.pattern->Expression() << ')';
     }
 
-    // Determine where to start writing the next line
-    size_t skip = 0;
-    while (std::isblank(description[count]) && count < _desc_width) ++skip;
-    if (skip != _desc_width) {
-      count += skip;
-      stream.write(&description[count], int(description.size() - count));
+    if (pinned_iter != _pinned.end()) {
+      if (argument.kind != ArgumentKind::kPlain || argument.pattern)
+        description << ' ';
+      if (!pinned_iter->second.present)
+        description << "[pinned: off]";
+      else if (!argument.value)
+        description << "[pinned: on]";
+      else
+        description << "[pinned: " << pinned_iter->second.value << "]";
     }
-    return stream.str();
+    return description.str();
   }
 
-  std::string GenerateArgumentUsage(const std::vector<Argument>& arguments) const {
+  // Required flags listed outside the "Required flags" section are marked as such
+  std::string FormatArgument(const Argument& argument, const bool mark_required = false) const {
     std::stringstream output;
-    for (size_t i = 0; i < arguments.size(); ++i) {
-      std::stringstream flag_ids;
-      flag_ids << "    " << arguments[i].flag;
-      if (arguments[i].value)
+    std::stringstream flag_ids;
+    flag_ids << "    " << argument.flag;
+    if (argument.value)
+      flag_ids << "=value";
+    if (!argument.flag.Empty() && !argument.alias.Empty())
+      flag_ids << "/";
+    if (!argument.alias.Empty()) {
+      flag_ids << argument.alias;
+      if (argument.value)
         flag_ids << "=value";
-      if (!arguments[i].flag.empty() && !arguments[i].alias.empty())
-        flag_ids << "/";
-      if (!arguments[i].alias.empty()) {
-        flag_ids << arguments[i].alias;
-        if (arguments[i].value)
-          flag_ids << "=value";
-      }
-
-      output << std::left << std::setw(_desc_start) << flag_ids.str();
-      output << std::left << this->FormatDescription(arguments[i].description);
-      output << '\n';
     }
+
+    output << std::left << std::setw(_desc_start) << flag_ids.str();
+    std::string description = this->DescribeArgument(argument);
+    if (mark_required)
+      description += description.empty() ? "(required)" : " (required)";
+    output << std::left << this->FormatDescription(description);
+    output << '\n';
     return output.str();
   }
 
-  void GenerateUsage() {
+  // Renders the arguments of one group. Named groups mix required and optional flags, so their
+  // required flags are marked.
+  std::string GenerateArgumentUsage(const std::vector<Argument>& arguments, const uint32_t group) const {
     std::stringstream output;
-    if (_required.size() > 0)
-      output << "\n  Required flags:\n";
-    output << this->GenerateArgumentUsage(_required);
+    const bool mark_required = (group != 0 && &arguments == &_required);
+    for (size_t i = 0; i < arguments.size(); ++i) {
+      if (arguments[i].group == group)
+        output << this->FormatArgument(arguments[i], mark_required);
+    }
+    return output.str();
+  }
+
+  static std::string Lowercase(std::string text) {
+    for (auto& c : text)
+      c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return text;
+  }
+
+  // Built on the first filtered help, so each filter is one substring search over a single buffer
+  void BuildHelpIndex() const {
+    std::lock_guard<std::mutex> lock(_usage_mutex.mutex);
+    if (!_help_offsets.empty() || _required.size() + _optional.size() == 0)
+      return;
+    _help_index.clear();
+    for (const auto* arguments : { &_required, &_optional }) {
+      for (const auto& argument : *arguments) {
+        _help_offsets.push_back(_help_index.size());
+        _help_index += argument.flag.Text() + ' ' + argument.alias.Text() + ' ';
+        _help_index += this->Description(argument) + '\n';
+      }
+    }
+    _help_index = Lowercase(_help_index);
+  }
 
-    if (_optional.size() > 0)
-      output << "\n  Optional flags:\n";
-    output << this->GenerateArgumentUsage(_optional);
+  // Safe to call from several threads. Once it returns the rendered members only change when the
+  // instance is modified, which needs exclusive access anyway.
+  void GenerateUsage() const {
+    std::lock_guard<std::mutex> lock(_usage_mutex.mutex);
+    if (!_usage_stale)
+      return;
+    _usage_stale = false;
+
+    std::stringstream output;
+    std::string section = this->GenerateArgumentUsage(_required, 0);
+    if (!section.empty())
+      output << "\n  Required flags:\n" << section;
+
+    section = this->GenerateArgumentUsage(_optional, 0);
+    if (!section.empty())
+      output << "\n  Optional flags:\n" << section;
+
+    for (uint32_t group = 1; group < _groups.size(); ++group) {
+      section = this->GenerateArgumentUsage(_required, group) + this->GenerateArgumentUsage(_optional, group);
+      if (!section.empty())
+        output << "\n  " << _groups[group] << ":\n" << section;
+    }
 
     if (_nonflags_required > 0) {
       output << "\n  " << _nonflags_required << " non-flags are required" << std::endl;
     }
 
-    _flag_description = output.str();
+    if (!_custom_flag_description)
+      _flag_description = output.str();
 
     output.str("");
     output << "Usage: " << _binary << ' ';
     for (size_t i = 0; i < _optional.size(); ++i) {
       output << "[" << _optional[i].flag;
-      if (!_optional[i].flag.empty()) {
+      if (!_optional[i].flag.Empty()) {
         if (_optional[i].value)
           output << "=value";
       }
 
-      if (!_optional[i].alias.empty()) {
+      if (!_optional[i].alias.Empty()) {
         output << "|" << _optional[i].alias;
         if (_optional[i].value)
           output << "=value";
@@ -744,7 +3966,7 @@ class Args {
       output << _required[i].flag;
       if (_required[i].value)
         output << "=value";
-      if (!_required[i].alias.empty()) {
+      if (!_required[i].alias.Empty()) {
           output << "|" << _required[i].alias;
           if (_required[i].value)
             output << "=value";
@@ -760,153 +3982,411 @@ class Args {
     }
 
     output << "\n";
-    _preamble = output.str();
+    if (!_custom_preamble)
+      _preamble = output.str();
+  }
+};
+
+// Makes the SARGS_* macros use another instance on this thread until it goes out of scope, so
+// code written against the macros can be tested in parallel with different flags. Scopes nest
+// and must be destroyed on the thread that created them.
+class ScopedArgs {
+ public:
+  // Uses a fresh instance owned by the scope
+  ScopedArgs() : ScopedArgs(nullptr) {}
+
+  explicit ScopedArgs(Args& args) : ScopedArgs(&args) {}
+
+  ScopedArgs(const ScopedArgs&) = delete;
+  ScopedArgs& operator=(const ScopedArgs&) = delete;
+
+  ~ScopedArgs() {
+    Args::Scoped() = _previous;
+  }
+
+  Args& Get() {
+    return *_args;
+  }
+
+ private:
+  Args _owned;
+  Args* _args;
+  Args* _previous;
+
+  explicit ScopedArgs(Args* args) : _args(args != nullptr ? args : &_owned), _previous(Args::Scoped()) {
+    Args::Scoped() = _args;
+  }
+};
+
+// Registers a pin with the default instance during static initialization
+struct PinRegistrar {
+  PinRegistrar(const char* flag, const bool enabled) {
+    Args::Default().PinFlag(flag, enabled);
+  }
+
+  PinRegistrar(const char* flag, const int64_t value) {
+    Args::Default().PinFlagValue(flag, std::to_string(value));
   }
 };
 
+#define SARGS_CONCAT_IMPL(a, b) a##b
+#define SARGS_CONCAT(a, b) SARGS_CONCAT_IMPL(a, b)
+
+// Pins a flag without a value on or off at build time. Must be used at global scope, typically in
+// a header shared by every file that reads the flag. With SARGS_ENABLE_PINS defined, SARGS_HAS()
+// on the pinned name folds to a constant expression
+#define SARGS_PIN(flag, enabled) \
+  namespace sargs { \
+  template <> struct PinnedFlag<sargs::HashFlag(flag)> { \
+    static constexpr bool Pinned() { return true; } \
+    static constexpr bool Present() { return (enabled); } \
+    static constexpr int64_t Value() { return (enabled) ? 1 : 0; } \
+  }; \
+  } \
+  static const sargs::PinRegistrar SARGS_CONCAT(sargs_pin_, __LINE__)(flag, static_cast<bool>(enabled))
+
+// Pins an integer value flag at build time. Must be used at global scope. With SARGS_ENABLE_PINS
+// defined, the integer getters on the pinned name fold to constant expressions
+#define SARGS_PIN_INT(flag, pinned_value) \
+  namespace sargs { \
+  template <> struct PinnedFlag<sargs::HashFlag(flag)> { \
+    static constexpr bool Pinned() { return true; } \
+    static constexpr bool Present() { return true; } \
+    static constexpr int64_t Value() { return (pinned_value); } \
+  }; \
+  } \
+  static const sargs::PinRegistrar SARGS_CONCAT(sargs_pin_, __LINE__)(flag, static_cast<int64_t>(pinned_value))
+
+// Define SARGS_ENABLE_PINS before including sargs.h to resolve pinned flags at compile time. The flag
+// passed to SARGS_HAS() and the integer getters must then be a string literal
+#if defined(SARGS_ENABLE_PINS)
+#define SARGS_PINNED_OR(type, flag, lookup) \
+  (sargs::PinnedFlag<sargs::HashFlag(flag)>::Pinned() ? \
+    static_cast<type>(sargs::PinnedFlag<sargs::HashFlag(flag)>::Value()) : (lookup))
+#define SARGS_PINNED_HAS(flag, lookup) \
+  (sargs::PinnedFlag<sargs::HashFlag(flag)>::Pinned() ? \
+    sargs::PinnedFlag<sargs::HashFlag(flag)>::Present() : (lookup))
+#else
+#define SARGS_PINNED_OR(type, flag, lookup) (lookup)
+#define SARGS_PINNED_HAS(flag, lookup) (lookup)
+#endif
+
 // Parses and verifies the arguments to ensure the flags are recognized and well-formed
 #define SARGS_INITIALIZE(argc, argv) \
-  sargs::Args::Default().Initialize(argc, argv)
+  sargs::Args::Current().Initialize(argc, argv)
+
+// Parses and verifies the arguments on a background thread. The first getter waits for it to finish
+#define SARGS_INITIALIZE_ASYNC(argc, argv) \
+  sargs::Args::Current().InitializeAsync(argc, argv)
+
+// Marks a string literal description to be referenced instead of copied. Anything but a literal
+// fails to compile, so the text always outlives the instance
+#define SARGS_LITERAL(text) \
+  sargs::DescriptionText::Literal("" text, sizeof("" text) - 1)
 
 // Tells Sargs that a flag is required and will have no value
 #define SARGS_REQUIRED_FLAG(flag, alias, description) \
-  sargs::Args::Default().AddRequiredFlag(flag, alias, description)
+  sargs::Args::Current().AddRequiredFlag(flag, alias, description)
 
 // Tells Sargs that a flag is required and will have a value with no default value
 #define SARGS_REQUIRED_FLAG_VALUE(flag, alias, description) \
-  sargs::Args::Default().AddRequiredFlagValue(flag, alias, description, "")
+  sargs::Args::Current().AddRequiredFlagValue(flag, alias, description, "")
 
 // Tells Sargs that a flag is required and will have a value with a default value
 #define SARGS_REQUIRED_FLAG_VALUE_DEFAULT(flag, alias, description, fallback) \
-  sargs::Args::Default().AddRequiredFlagValue(flag, alias, description, fallback)
+  sargs::Args::Current().AddRequiredFlagValue(flag, alias, description, fallback)
 
 // Tells Sargs that an optional flag should be expected with no value
 #define SARGS_OPTIONAL_FLAG(flag, alias, description) \
-  sargs::Args::Default().AddOptionalFlag(flag, alias, description)
+  sargs::Args::Current().AddOptionalFlag(flag, alias, description)
 
 // Tells Sargs that an optional flag should be expected and will have a value with no default value
 #define SARGS_OPTIONAL_FLAG_VALUE(flag, alias, description) \
-  sargs::Args::Default().AddOptionalFlagValue(flag, alias, description, "")
+  sargs::Args::Current().AddOptionalFlagValue(flag, alias, description, "")
 
 // Tells Sargs that an optional flag should be expected, will have a value and a default value
 #define SARGS_OPTIONAL_FLAG_VALUE_DEFAULT(flag, alias, description, fallback) \
-  sargs::Args::Default().AddOptionalFlagValue(flag, alias, description, fallback)
+  sargs::Args::Current().AddOptionalFlagValue(flag, alias, description, fallback)
+
+// Tells Sargs that a flag is required and its value must be one of the listed choices,
+// e.g. SARGS_REQUIRED_FLAG_ENUM("--mode", "-m", "Mode", {"fast", kFast}, {"safe", kSafe})
+#define SARGS_REQUIRED_FLAG_ENUM(flag, alias, description, ...) \
+  sargs::Args::Current().AddRequiredFlagEnum(flag, alias, description, \
+                                             std::vector<sargs::Choice>{__VA_ARGS__})
+
+// Tells Sargs that an optional flag's value must be one of the listed choices
+#define SARGS_OPTIONAL_FLAG_ENUM(flag, alias, description, ...) \
+  sargs::Args::Current().AddOptionalFlagEnum(flag, alias, description, \
+                                             std::vector<sargs::Choice>{__VA_ARGS__})
+
+// Tells Sargs that an optional flag's value must be one of the listed choices with a default choice
+#define SARGS_OPTIONAL_FLAG_ENUM_DEFAULT(flag, alias, description, fallback, ...) \
+  sargs::Args::Current().AddOptionalFlagEnum(flag, alias, description, \
+                                             std::vector<sargs::Choice>{__VA_ARGS__}, fallback)
+
+// Tells Sargs that a flag is required and its value is a comma separated subset of the listed names,
+// e.g. SARGS_REQUIRED_FLAG_SET("--features", "", "Features", "a", "b", "c")
+#define SARGS_REQUIRED_FLAG_SET(flag, alias, description, ...) \
+  sargs::Args::Current().AddRequiredFlagSet(flag, alias, description, \
+                                            std::vector<std::string>{__VA_ARGS__})
+
+// Tells Sargs that an optional flag's value is a comma separated subset of the listed names
+#define SARGS_OPTIONAL_FLAG_SET(flag, alias, description, ...) \
+  sargs::Args::Current().AddOptionalFlagSet(flag, alias, description, \
+                                            std::vector<std::string>{__VA_ARGS__})
+
+// Tells Sargs that an optional flag's value is a comma separated subset of the listed names with a default
+#define SARGS_OPTIONAL_FLAG_SET_DEFAULT(flag, alias, description, fallback, ...) \
+  sargs::Args::Current().AddOptionalFlagSet(flag, alias, description, \
+                                            std::vector<std::string>{__VA_ARGS__}, fallback)
+
+// Tells Sargs that a flag is required and takes key=value entries, comma separated and repeatable
+#define SARGS_REQUIRED_FLAG_MAP(flag, alias, description) \
+  sargs::Args::Current().AddRequiredFlagMap(flag, alias, description)
+
+// Tells Sargs that an optional flag takes key=value entries, comma separated and repeatable
+#define SARGS_OPTIONAL_FLAG_MAP(flag, alias, description) \
+  sargs::Args::Current().AddOptionalFlagMap(flag, alias, description)
+
+// Tells Sargs that a flag is required and its value may be a sweep such as 1:64:x2 or {16,32,64}
+#define SARGS_REQUIRED_FLAG_SWEEP(flag, alias, description) \
+  sargs::Args::Current().AddRequiredFlagSweep(flag, alias, description)
+
+// Tells Sargs that an optional flag's value may be a sweep such as 1:64:x2 or {16,32,64}
+#define SARGS_OPTIONAL_FLAG_SWEEP(flag, alias, description) \
+  sargs::Args::Current().AddOptionalFlagSweep(flag, alias, description)
+
+// Tells Sargs that an optional flag's value may be a sweep with a default value or sweep
+#define SARGS_OPTIONAL_FLAG_SWEEP_DEFAULT(flag, alias, description, fallback) \
+  sargs::Args::Current().AddOptionalFlagSweep(flag, alias, description, fallback)
+
+// Tells Sargs that a flag is required and its value is a number
+#define SARGS_REQUIRED_FLAG_NUMBER(flag, alias, description) \
+  sargs::Args::Current().AddRequiredFlagNumber(flag, alias, description)
+
+// Tells Sargs that an optional flag's value is a number
+#define SARGS_OPTIONAL_FLAG_NUMBER(flag, alias, description) \
+  sargs::Args::Current().AddOptionalFlagNumber(flag, alias, description)
+
+// Tells Sargs that an optional flag's value is a number with a default value
+#define SARGS_OPTIONAL_FLAG_NUMBER_DEFAULT(flag, alias, description, fallback) \
+  sargs::Args::Current().AddOptionalFlagNumber(flag, alias, description, fallback)
+
+// Tells Sargs that a flag is required and its value is hex encoded bytes
+#define SARGS_REQUIRED_FLAG_HEX(flag, alias, description) \
+  sargs::Args::Current().AddRequiredFlagHex(flag, alias, description)
+
+// Tells Sargs that an optional flag's value is hex encoded bytes
+#define SARGS_OPTIONAL_FLAG_HEX(flag, alias, description) \
+  sargs::Args::Current().AddOptionalFlagHex(flag, alias, description)
+
+// Tells Sargs that a flag is required and its value is base64 encoded bytes
+#define SARGS_REQUIRED_FLAG_BASE64(flag, alias, description) \
+  sargs::Args::Current().AddRequiredFlagBase64(flag, alias, description)
+
+// Tells Sargs that an optional flag's value is base64 encoded bytes
+#define SARGS_OPTIONAL_FLAG_BASE64(flag, alias, description) \
+  sargs::Args::Current().AddOptionalFlagBase64(flag, alias, description)
 
 // Replace the default preamble with a custom one
 #define SARGS_SET_PREAMBLE(preamble) \
-  sargs::Args::Default().SetPreamble(preamble)
+  sargs::Args::Current().SetPreamble(preamble)
 
 // Set the epilogue
 #define SARGS_SET_EPILOGUE(epilogue) \
-  sargs::Args::Default().SetEpilogue(epilogue)
+  sargs::Args::Current().SetEpilogue(epilogue)
 
 // Replace the default flag description string with a custom one
 #define SARGS_SET_FLAG_DESCRIPTION(flag_description) \
-  sargs::Args::Default().SetFlagDescription(flag_description)
+  sargs::Args::Current().SetFlagDescription(flag_description)
 
 // Gets the currently set preamble string
 #define SARGS_GET_PREAMBLE() \
-  sargs::Args::Default().GetPreamble()
+  sargs::Args::Current().GetPreamble()
 
 // Gets the currently set epilogue string
 #define SARGS_GET_EPILOGUE() \
-  sargs::Args::Default().GetEpilogue()
+  sargs::Args::Current().GetEpilogue()
 
 // Gets the currently set flag description string
 #define SARGS_GET_FLAG_DESCRIPTION() \
-  sargs::Args::Default().GetFlagDescription()
+  sargs::Args::Current().GetFlagDescription()
 
 // Get the binary string which is passed as argv[0]
 #define SARGS_GET_BINARY() \
-  sargs::Args::Default().Binary()
+  sargs::Args::Current().Binary()
 
 // Print the usage to the specified stream
 #define SARGS_PRINT_USAGE(ostream) \
-  sargs::Args::Default().PrintUsage(ostream)
+  sargs::Args::Current().PrintUsage(ostream)
 
 // Print the usage to std::cout
 #define SARGS_PRINT_USAGE_TO_COUT() \
-  sargs::Args::Default().PrintUsage(std::cout)
+  sargs::Args::Current().PrintUsage(std::cout)
 
 // Require that at least count non-flags are specified by the user
 #define SARGS_REQUIRE_NONFLAGS(count) \
-  sargs::Args::Default().RequireNonFlags(count)
+  sargs::Args::Current().RequireNonFlags(count)
 
 // Get a non-flag based on the index it was specified by the user
 #define SARGS_GET_NONFLAG(index) \
-  sargs::Args::Default().GetNonFlag(index)
+  sargs::Args::Current().GetNonFlag(index)
 
 // Gets all non-flags
 #define SARGS_GET_NONFLAGS() \
-  sargs::Args::Default().GetNonFlags()
+  sargs::Args::Current().GetNonFlags()
 
 // Get the value of a flag as an uint64_t
 #define SARGS_GET_UINT64(flag) \
-  sargs::Args::Default().GetAsUInt64(flag)
+  SARGS_PINNED_OR(uint64_t, flag, sargs::Args::Current().GetAsUInt64(flag))
 
 // Get the value of a flag as an uint32_t
 #define SARGS_GET_UINT32(flag) \
-  sargs::Args::Default().GetAsUInt32(flag)
+  SARGS_PINNED_OR(uint32_t, flag, sargs::Args::Current().GetAsUInt32(flag))
 
 // Get the value of a flag as an uint16_t
 #define SARGS_GET_UINT16(flag) \
-  sargs::Args::Default().GetAsUInt16(flag)
+  SARGS_PINNED_OR(uint16_t, flag, sargs::Args::Current().GetAsUInt16(flag))
 
 // Get the value of a flag as an uint8_t
 #define SARGS_GET_UINT8(flag) \
-  sargs::Args::Default().GetAsUInt8(flag)
+  SARGS_PINNED_OR(uint8_t, flag, sargs::Args::Current().GetAsUInt8(flag))
 
 // Get the value of a flag as an int64_t
 #define SARGS_GET_INT64(flag) \
-  sargs::Args::Default().GetAsInt64(flag)
+  SARGS_PINNED_OR(int64_t, flag, sargs::Args::Current().GetAsInt64(flag))
 
 // Get the value of a flag as an int32_t
 #define SARGS_GET_INT32(flag) \
-  sargs::Args::Default().GetAsInt32(flag)
+  SARGS_PINNED_OR(int32_t, flag, sargs::Args::Current().GetAsInt32(flag))
 
 // Get the value of a flag as an int16_t
 #define SARGS_GET_INT16(flag) \
-  sargs::Args::Default().GetAsInt16(flag)
+  SARGS_PINNED_OR(int16_t, flag, sargs::Args::Current().GetAsInt16(flag))
 
 // Get the value of a flag as an int8_t
 #define SARGS_GET_INT8(flag) \
-  sargs::Args::Default().GetAsInt8(flag)
+  SARGS_PINNED_OR(int32_t, flag, sargs::Args::Current().GetAsInt8(flag))
 
 // Get the value of a flag as a std::string
 #define SARGS_GET_STRING(flag) \
-  sargs::Args::Default().GetAsString(flag)
+  sargs::Args::Current().GetAsString(flag)
 
 // Get the value of a flag as a float
 #define SARGS_GET_FLOAT(flag) \
-  sargs::Args::Default().GetAsFloat(flag)
+  sargs::Args::Current().GetAsFloat(flag)
+
+// Get the decoded integer of an enum flag
+#define SARGS_GET_ENUM(flag) \
+  sargs::Args::Current().GetAsEnum(flag)
+
+// Get the decoded value of an enum flag converted to a user enum type
+#define SARGS_GET_ENUM_AS(type, flag) \
+  sargs::Args::Current().GetAsEnum<type>(flag)
+
+// Get the decoded bitmask of a set flag. Bit i is set if the i-th name was given
+#define SARGS_GET_BITMASK(flag) \
+  sargs::Args::Current().GetAsBitmask(flag)
+
+// Get the decoded entries of a map flag as a sargs::FlatMap
+#define SARGS_GET_MAP(flag) \
+  sargs::Args::Current().GetAsMap(flag)
+
+// Get the decoded bytes of a hex or base64 flag as a sargs::ByteSpan
+#define SARGS_GET_BYTES(flag) \
+  sargs::Args::Current().GetAsBytes(flag)
+
+// Get the cartesian product of all sweep flags, iterable as sargs::Sweep::Point values
+#define SARGS_GET_SWEEP() \
+  sargs::Args::Current().GetSweep()
+
+// Get the stable hash of the effective configuration
+#define SARGS_FINGERPRINT() \
+  sargs::Args::Current().Fingerprint()
+
+// Exclude a flag that does not affect results from SARGS_FINGERPRINT()
+#define SARGS_MARK_NON_SEMANTIC(flag) \
+  sargs::Args::Current().MarkNonSemantic(flag)
 
 // Return a bool of the flag was specified
 #define SARGS_HAS(flag) \
-  sargs::Args::Default().Has(flag)
+  SARGS_PINNED_HAS(flag, sargs::Args::Current().Has(flag))
 
 // Disable default -h and --help flags. These will do nothing if specified by
 // the user when this is called before SARGS_INITIALIZE()
 #define SARGS_DISABLE_HELP() \
-  sargs::Args::Default().DisableHelp()
+  sargs::Args::Current().DisableHelp()
 
 // Disables the call to std::exit if there is a problem during initialization
 #define SARGS_DISABLE_EXIT() \
-  sargs::Args::Default().DisableExit()
+  sargs::Args::Current().DisableExit()
+
+// Get a view of the flags registered as --<name>.<flag>
+#define SARGS_SCOPE(name) \
+  sargs::Args::Current().Scope(name)
+
+// Keep unrecognized flags pending so flags registered later can claim them
+#define SARGS_ENABLE_PERMISSIVE() \
+  sargs::Args::Current().EnablePermissive()
+
+// Bind flags registered since initialization, e.g. by a plugin, to the pending command line flags
+#define SARGS_CLAIM_PENDING() \
+  sargs::Args::Current().ClaimPending()
+
+// Fail like initialization if a pending flag was never claimed
+#define SARGS_CHECK_UNCLAIMED() \
+  sargs::Args::Current().CheckUnclaimed()
+
+// Return a sargs::MemoryReport of the bytes used by the current instance
+#define SARGS_MEMORY_USAGE() \
+  sargs::Args::Current().MemoryUsage()
+
+// Discards flag descriptions in processes that will never print usage
+#define SARGS_FREEZE() \
+  sargs::Args::Current().Freeze()
+
+// Return the completion candidates for words[index] of a command line
+#define SARGS_COMPLETE(words, index) \
+  sargs::Args::Current().Complete(words, index)
+
+// Return the JSON schema of the registered flags
+#define SARGS_SCHEMA() \
+  sargs::Args::Current().Schema()
+
+// Bounds the command lines accepted by SARGS_INITIALIZE() with a sargs::ParseLimits
+#define SARGS_SET_LIMITS(limits) \
+  sargs::Args::Current().SetLimits(limits)
+
+// Applies conservative limits for command lines from untrusted sources
+#define SARGS_ENABLE_HARDENED() \
+  sargs::Args::Current().EnableHardened()
+
+// Requires every value of a flag to match a restricted regular expression, compiled once into a DFA
+#define SARGS_PATTERN(flag, expression) \
+  sargs::Args::Current().SetPattern(flag, expression)
+
+// Lists the flags registered after it under group in usage and --help=<group>
+#define SARGS_GROUP(group) \
+  sargs::Args::Current().SetGroup(group)
+
+// Print only the flags of a group or those matching a substring to an ostream
+#define SARGS_PRINT_USAGE_MATCHING(ostream, filter) \
+  sargs::Args::Current().PrintUsage(ostream, filter)
 
 // Disables all exceptions in Sargs
 #define SARGS_DISABLE_EXCEPTIONS() \
-  sargs::Args::Default().DisableExceptions()
+  sargs::Args::Current().DisableExceptions()
 
 // Disables printing usage if an error is encountered during initialization
 #define SARGS_DISABLE_USAGE() \
-  sargs::Args::Default().DisableUsage()
+  sargs::Args::Current().DisableUsage()
 
 // Sets the start column of each description in the usage generator. Default: 30
 #define SARGS_SET_DESC_START_COLUMN(column) \
-  sargs::Args::Default().SetDescStartColumn(column)
+  sargs::Args::Current().SetDescStartColumn(column)
 
 // Sets the max width of a flag description before wrapping. Default: 50
 #define SARGS_SET_DESC_WIDTH(width) \
-  sargs::Args::Default().SetDescWidth(width)
+  sargs::Args::Current().SetDescWidth(width)
 
 }  // namespace sargs
@@ -0,0 +1,257 @@
+//
+// Copyright (c) 2017-2021 Daniel Ali. All rights reserved.
+// See LICENSE for details.
+//
+#pragma once
+
+#include "sargs.h"
+#include <thread>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace sargs {
+
+// Answers one admin query about an initialized Args: flags, timings, reads, memory or all, each
+// optionally followed by json. Unknown queries list the commands.
+inline std::string AnswerAdminQuery(const Args& args, const std::string& query) {
+  std::stringstream input(query);
+  std::string command;
+  std::string format;
+  input >> command >> format;
+  if (command.empty())
+    command = "all";
+  const bool json = (format == "json");
+  const bool all = (command == "all");
+  if (!all && command != "flags" && command != "timings" && command != "reads" && command != "memory")
+    return "Commands: flags, timings, reads, memory, all. Add json for JSON output.\n";
+
+  std::stringstream output;
+  bool first = true;
+  if (json)
+    output << '{';
+
+  if (all || command == "flags" || command == "reads") {
+    const bool reads_only = (command == "reads");
+    const std::vector<FlagState> states = args.Inspect();
+    if (json) {
+      output << "\"flags\": [";
+      for (size_t i = 0; i < states.size(); ++i) {
+        output << (i == 0 ? "" : ", ") << "{\"flag\": " << JsonString(states[i].flag)
+               << ", \"alias\": " << JsonString(states[i].alias);
+        if (!reads_only) {
+          output << ", \"value\": " << JsonString(states[i].value)
+                 << ", \"source\": \"" << SourceName(states[i].source) << '"';
+        }
+        output << ", \"reads\": " << states[i].reads << '}';
+      }
+      output << ']';
+    } else {
+      for (const auto& state : states) {
+        output << (state.flag.empty() ? state.alias : state.flag);
+        if (!reads_only)
+          output << " = " << state.value << " (" << SourceName(state.source) << ')';
+        output << (reads_only ? " " : ", ") << state.reads << " reads\n";
+      }
+    }
+    first = false;
+  }
+
+  if (all || command == "timings") {
+    const InitializeTimings timings = args.Timings();
+    const std::pair<const char*, uint64_t> phases[] = {
+      { "parse", timings.parse }, { "fallbacks", timings.fallbacks }, { "decode", timings.decode },
+      { "fingerprint", timings.fingerprint }, { "hooks", timings.hooks }, { "total", timings.total }
+    };
+    if (json) {
+      output << (first ? "" : ", ") << "\"timings_ns\": {\"initializations\": " << timings.count;
+      for (const auto& phase : phases)
+        output << ", \"" << phase.first << "\": " << phase.second;
+      output << '}';
+    } else {
+      output << "initializations: " << timings.count << '\n';
+      for (const auto& phase : phases)
+        output << phase.first << ": " << phase.second << " ns\n";
+    }
+    first = false;
+  }
+
+  if (all || command == "memory") {
+    const MemoryReport report = args.MemoryUsage();
+    const std::pair<const char*, size_t> categories[] = {
+      { "registry", report.registry }, { "descriptions", report.descriptions }, { "values", report.values },
+      { "usage", report.usage }, { "names", report.names }, { "total", report.Total() }
+    };
+    if (json) {
+      output << (first ? "" : ", ") << "\"memory_bytes\": {";
+      for (size_t i = 0; i < 6; ++i)
+        output << (i == 0 ? "" : ", ") << '"' << categories[i].first << "\": " << categories[i].second;
+      output << '}';
+    } else {
+      for (const auto& category : categories)
+        output << category.first << ": " << category.second << " bytes\n";
+    }
+  }
+
+  if (json)
+    output << "}\n";
+  return output.str();
+}
+
+// Serves admin queries on a Unix domain socket from a background thread. Each connection sends
+// one query line and gets the answer before the socket is closed. A path starting with '@' names
+// a Linux abstract socket. Start it after Initialize(). It may keep running while the Args is
+// initialized again: queries go through Inspect(), Timings() and MemoryUsage(), which wait for
+// Initialize() to finish changing the values. Getters take no lock, so they run exactly as fast
+// as without it.
+//
+// Socket files are created with mode 0600, and a stale socket left by a crashed process is
+// replaced. Abstract sockets have no permissions, so on Linux every connection is checked with
+// SO_PEERCRED and only the process's own user and root are answered.
+class AdminServer {
+ public:
+  AdminServer(const Args& args, const std::string& path) : _args(args), _path(path) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+      throw SargsError("Invalid admin socket path " + path);
+    std::memcpy(address.sun_path, path.data(), path.size());
+    socklen_t length = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size());
+    if (path[0] == '@')
+      address.sun_path[0] = '\0';
+    else
+      ++length;
+
+    if (pipe(_wake) != 0)
+      throw SargsError("Could not create the admin socket wake pipe");
+    const bool file = (path[0] != '@');
+    if (file)
+      RemoveStaleSocket(address, length);
+    _socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    // Nobody can connect before listen(), so restricting the file in between leaves no window
+    if (_socket < 0 || bind(_socket, reinterpret_cast<sockaddr*>(&address), length) != 0 ||
+        (file && chmod(path.c_str(), S_IRUSR | S_IWUSR) != 0) || listen(_socket, 8) != 0) {
+      this->Close();
+      throw SargsError("Could not listen on admin socket " + path);
+    }
+    _thread = std::thread([this]() { this->Serve(); });
+  }
+
+  AdminServer(const AdminServer&) = delete;
+  AdminServer& operator=(const AdminServer&) = delete;
+
+  ~AdminServer() {
+    const char stop = 0;
+    if (write(_wake[1], &stop, 1) == 1 && _thread.joinable())
+      _thread.join();
+    this->Close();
+    if (_path[0] != '@')
+      unlink(_path.c_str());
+  }
+
+ private:
+  const Args& _args;
+  std::string _path;
+  int _socket = -1;
+  int _wake[2] = { -1, -1 };
+  std::thread _thread;
+
+  // Unlinks a socket file nobody listens on. Anything else at the path makes bind() fail.
+  static void RemoveStaleSocket(const sockaddr_un& address, const socklen_t length) {
+    struct stat status;
+    if (lstat(address.sun_path, &status) != 0 || !S_ISSOCK(status.st_mode))
+      return;
+    const int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0)
+      return;
+    const bool stale = connect(probe, reinterpret_cast<const sockaddr*>(&address), length) != 0 &&
+      errno == ECONNREFUSED;
+    close(probe);
+    if (stale)
+      unlink(address.sun_path);
+  }
+
+  static bool Trusted(const int client) {
+#ifdef SO_PEERCRED
+    ucred credentials;
+    socklen_t size = sizeof(credentials);
+    if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &credentials, &size) != 0)
+      return false;
+    return credentials.uid == geteuid() || credentials.uid == 0;
+#else
+    (void) client;
+    return true;
+#endif
+  }
+
+  void Close() {
+    for (int* fd : { &_socket, &_wake[0], &_wake[1] }) {
+      if (*fd >= 0)
+        close(*fd);
+      *fd = -1;
+    }
+  }
+
+  void Serve() {
+    pollfd fds[2] = { { _socket, POLLIN, 0 }, { _wake[0], POLLIN, 0 } };
+    for (;;) {
+      fds[0].revents = 0;
+      fds[1].revents = 0;
+      if (poll(fds, 2, -1) < 0) {
+        if (errno == EINTR)
+          continue;
+        return;
+      }
+      if (fds[1].revents != 0)
+        return;
+      if ((fds[0].revents & POLLIN) == 0)
+        continue;
+      const int client = accept(_socket, nullptr, nullptr);
+      if (client < 0)
+        continue;
+      if (Trusted(client))
+        this->Answer(client);
+      close(client);
+    }
+  }
+
+  // Reads up to a newline, waiting at most a second so a silent client can't stall the server
+  void Answer(const int client) {
+    std::string query;
+    char buffer[256];
+    pollfd fd = { client, POLLIN, 0 };
+    while (query.size() < 4096 && query.find('\n') == std::string::npos && poll(&fd, 1, 1000) > 0) {
+      const ssize_t size = read(client, buffer, sizeof(buffer));
+      if (size <= 0)
+        break;
+      query.append(buffer, static_cast<size_t>(size));
+    }
+    query = query.substr(0, query.find_first_of("\r\n"));
+
+    const std::string answer = AnswerAdminQuery(_args, query);
+    size_t written = 0;
+    while (written < answer.size()) {
+      const ssize_t size = send(client, answer.data() + written, answer.size() - written, MSG_NOSIGNAL);
+      if (size <= 0)
+        break;
+      written += static_cast<size_t>(size);
+    }
+  }
+};
+
+}  // namespace sargs
+
+// Serves admin queries about the current instance on a Unix domain socket until the program exits.
+// The instance is picked when the statement first runs, so inside a ScopedArgs it is the scoped one
+#define SARGS_ADMIN_SOCKET(path) \
+  static sargs::AdminServer sargs_admin_server(sargs::Args::Current(), path)
@@ -0,0 +1,262 @@
+//
+// Copyright (c) 2017-2021 Daniel Ali. All rights reserved.
+// See LICENSE for details.
+//
+#pragma once
+
+#include "sargs.h"
+
+namespace sargs {
+
+// Parsed JSON value, enough to read the output of Args::Schema()
+struct JsonValue {
+  enum class Type { kNull, kBool, kNumber, kString, kArray, kObject };
+
+  const JsonValue& operator[](const std::string& key) const {
+    static const JsonValue missing;
+    for (const auto& member : members) {
+      if (member.first == key)
+        return member.second;
+    }
+    return missing;
+  }
+
+  Type type = Type::kNull;
+  bool boolean = false;
+  int64_t number = 0;
+  std::string text;
+  std::vector<JsonValue> items;
+  std::vector<std::pair<std::string, JsonValue>> members;
+};
+
+// Recursive descent reader for JSON documents. Numbers must be integers.
+class JsonReader {
+ public:
+  explicit JsonReader(const std::string& json) : _json(json) {}
+
+  JsonValue Read() {
+    JsonValue value = this->ReadValue();
+    this->SkipSpace();
+    if (_position != _json.size())
+      this->Fail("Unexpected text after the document");
+    return value;
+  }
+
+ private:
+  const std::string& _json;
+  size_t _position = 0;
+
+  [[noreturn]] void Fail(const std::string& message) const {
+    throw SargsError("Invalid schema at offset " + std::to_string(_position) + ": " + message);
+  }
+
+  void SkipSpace() {
+    while (_position < _json.size() && std::isspace(static_cast<unsigned char>(_json[_position])))
+      ++_position;
+  }
+
+  bool Consume(const char c) {
+    this->SkipSpace();
+    if (_position < _json.size() && _json[_position] == c) {
+      ++_position;
+      return true;
+    }
+    return false;
+  }
+
+  void Expect(const char c) {
+    if (!this->Consume(c))
+      this->Fail(std::string("Expected '") + c + "'");
+  }
+
+  bool ConsumeWord(const std::string& word) {
+    if (_json.compare(_position, word.size(), word) != 0)
+      return false;
+    _position += word.size();
+    return true;
+  }
+
+  JsonValue ReadValue() {
+    this->SkipSpace();
+    JsonValue value;
+    if (_position >= _json.size())
+      this->Fail("Unexpected end");
+
+    const char c = _json[_position];
+    if (c == '{') {
+      value.type = JsonValue::Type::kObject;
+      ++_position;
+      if (this->Consume('}'))
+        return value;
+      do {
+        this->SkipSpace();
+        std::string key = this->ReadString();
+        this->Expect(':');
+        value.members.emplace_back(key, this->ReadValue());
+      } while (this->Consume(','));
+      this->Expect('}');
+    } else if (c == '[') {
+      value.type = JsonValue::Type::kArray;
+      ++_position;
+      if (this->Consume(']'))
+        return value;
+      do {
+        value.items.push_back(this->ReadValue());
+      } while (this->Consume(','));
+      this->Expect(']');
+    } else if (c == '"') {
+      value.type = JsonValue::Type::kString;
+      value.text = this->ReadString();
+    } else if (this->ConsumeWord("true") || this->ConsumeWord("false")) {
+      value.type = JsonValue::Type::kBool;
+      value.boolean = (c == 't');
+    } else if (this->ConsumeWord("null")) {
+      value.type = JsonValue::Type::kNull;
+    } else {
+      const size_t start = _position;
+      while (_position < _json.size() &&
+             (_json[_position] == '-' || std::isdigit(static_cast<unsigned char>(_json[_position]))))
+        ++_position;
+      value.type = JsonValue::Type::kNumber;
+      if (!ConvertToInt64(_json.substr(start, _position - start), value.number))
+        this->Fail("Expected a value");
+    }
+    return value;
+  }
+
+  std::string ReadString() {
+    if (_position >= _json.size() || _json[_position] != '"')
+      this->Fail("Expected a string");
+    ++_position;
+
+    std::string text;
+    while (_position < _json.size() && _json[_position] != '"') {
+      char c = _json[_position++];
+      if (c == '\\') {
+        if (_position >= _json.size())
+          break;
+        c = _json[_position++];
+        switch (c) {
+          case 'n': c = '\n'; break;
+          case 'r': c = '\r'; break;
+          case 't': c = '\t'; break;
+          case 'b': c = '\b'; break;
+          case 'f': c = '\f'; break;
+          case 'u': {
+            uint64_t code = 0;
+            if (_position + 4 > _json.size() || !ConvertToUInt64("0x" + _json.substr(_position, 4), code) ||
+                code > 0x7f)
+              this->Fail("Only ASCII \\u escapes are supported");
+            _position += 4;
+            c = static_cast<char>(code);
+            break;
+          }
+          default: break;
+        }
+      }
+      text += c;
+    }
+    if (_position >= _json.size())
+      this->Fail("Unterminated string");
+    ++_position;
+    return text;
+  }
+};
+
+// Builds an Args with the flags of a schema written by Args::Schema() or --sargs-dump-schema, so
+// command lines for the program can be checked without running it. Throws SargsError if the
+// schema is malformed.
+inline Args LoadSchema(const std::string& json) {
+  const JsonValue schema = JsonReader(json).Read();
+  if (schema.type != JsonValue::Type::kObject || schema["flags"].type != JsonValue::Type::kArray)
+    throw SargsError("Invalid schema: expected an object with a flags array");
+
+  Args args;
+  args.RequireNonFlags(static_cast<int>(schema["nonflags"].number));
+  // Schemas written before these settings were exported leave the defaults
+  if (schema["help"].type == JsonValue::Type::kBool && !schema["help"].boolean)
+    args.DisableHelp();
+  if (schema["permissive"].boolean)
+    args.EnablePermissive();
+  if (schema["hardened"].boolean)
+    args.EnableHardened();
+  const JsonValue& limits = schema["limits"];
+  if (limits.type == JsonValue::Type::kObject) {
+    ParseLimits parsed;
+    parsed.max_tokens = static_cast<size_t>(limits["max_tokens"].number);
+    parsed.max_token_length = static_cast<size_t>(limits["max_token_length"].number);
+    parsed.max_total_bytes = static_cast<size_t>(limits["max_total_bytes"].number);
+    parsed.max_repetitions = static_cast<size_t>(limits["max_repetitions"].number);
+    parsed.max_steps = static_cast<size_t>(limits["max_steps"].number);
+    args.SetLimits(parsed);
+  }
+  for (const auto& entry : schema["flags"].items) {
+    const std::string& flag = entry["flag"].text;
+    const std::string& alias = entry["alias"].text;
+    const std::string& description = entry["description"].text;
+    const std::string& fallback = entry["fallback"].text;
+    const std::string& kind = entry["kind"].text;
+    const bool required = entry["required"].boolean;
+    args.SetGroup(entry["group"].text);
+
+    std::vector<Choice> choices;
+    std::vector<std::string> names;
+    for (const auto& choice : entry["choices"].items) {
+      choices.emplace_back(choice["name"].text, choice["value"].number);
+      names.push_back(choice["name"].text);
+    }
+
+    if (kind == "enum" && required)
+      args.AddRequiredFlagEnum(flag, alias, description, choices);
+    else if (kind == "enum")
+      args.AddOptionalFlagEnum(flag, alias, description, choices, fallback);
+    else if (kind == "set" && required)
+      args.AddRequiredFlagSet(flag, alias, description, names);
+    else if (kind == "set")
+      args.AddOptionalFlagSet(flag, alias, description, names, fallback);
+    else if (kind == "sweep" && required)
+      args.AddRequiredFlagSweep(flag, alias, description);
+    else if (kind == "sweep")
+      args.AddOptionalFlagSweep(flag, alias, description, fallback);
+    else if (kind == "map" && required)
+      args.AddRequiredFlagMap(flag, alias, description);
+    else if (kind == "map")
+      args.AddOptionalFlagMap(flag, alias, description);
+    else if (kind == "hex" && required)
+      args.AddRequiredFlagHex(flag, alias, description);
+    else if (kind == "hex")
+      args.AddOptionalFlagHex(flag, alias, description, fallback);
+    else if (kind == "base64" && required)
+      args.AddRequiredFlagBase64(flag, alias, description);
+    else if (kind == "base64")
+      args.AddOptionalFlagBase64(flag, alias, description, fallback);
+    else if (kind == "number" && required)
+      args.AddRequiredFlagNumber(flag, alias, description);
+    else if (kind == "number")
+      args.AddOptionalFlagNumber(flag, alias, description, fallback);
+    else if (kind != "plain")
+      throw SargsError("Invalid schema: unknown kind " + kind + " of " + flag);
+    else if (!entry["value"].boolean && required)
+      args.AddRequiredFlag(flag, alias, description);
+    else if (!entry["value"].boolean)
+      args.AddOptionalFlag(flag, alias, description);
+    else if (required)
+      args.AddRequiredFlagValue(flag, alias, description, fallback);
+    else
+      args.AddOptionalFlagValue(flag, alias, description, fallback);
+
+    if (!entry["pattern"].text.empty())
+      args.SetPattern(flag.empty() ? alias : flag, entry["pattern"].text);
+  }
+  args.SetGroup("");
+
+  for (const auto& entry : schema["pinned"].items) {
+    if (!entry["value"].text.empty())
+      args.PinFlagValue(entry["flag"].text, entry["value"].text);
+    else
+      args.PinFlag(entry["flag"].text, entry["present"].boolean);
+  }
+  return args;
+}
+
+}  // namespace sargs
@@ -0,0 +1,435 @@
+//
+// Copyright (c) 2017-2021 Daniel Ali. All rights reserved.
+// See LICENSE for details.
+//
+#pragma once
+
+#include "sargs.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sargs {
+
+// Layout of a shared memory segment holding a published configuration. Every position is a byte
+// offset from the start of the segment, so the segment can be mapped at any address. Readers
+// reject segments with another magic or version.
+const uint32_t kSharedMagic = 0x53475253;  // "SRGS"
+const uint32_t kSharedVersion = 1;
+
+struct SharedString {
+  uint32_t offset;
+  uint32_t size;
+};
+
+// One name of a flag. A flag with an alias has an entry for each name, and entries are sorted by name.
+struct SharedFlag {
+  SharedString name;
+  SharedString value;
+  uint32_t has;     // Whether Has() is true, including fallbacks
+  uint32_t source;  // ValueSource
+};
+
+// Written only by the publisher. The sequence is odd while the rest of the segment is being
+// rewritten, so readers retry when it is odd or changed while they copied.
+struct SharedHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t segment_size;
+  std::atomic<uint64_t> sequence;
+  uint64_t fingerprint;
+  uint32_t used;           // Bytes of the segment in use, header included
+  uint32_t flag_count;
+  uint32_t flag_table;     // Offset of SharedFlag[flag_count]
+  uint32_t nonflag_count;
+  uint32_t nonflag_table;  // Offset of SharedString[nonflag_count]
+  uint32_t publisher;      // Process id of the publisher, for diagnostics only
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+              "Shared sequence must be a plain 64 bit word");
+
+// Publishes the parsed state of an Args to a named POSIX shared memory segment, so sidecar
+// processes read the effective configuration instead of parsing the command line again. The
+// configuration is published again after every successful Initialize() of args. Keep the
+// publisher alive as long as args may be initialized; the segment is removed when it is destroyed.
+// The segment is created with the given mode regardless of the umask, readable only by the owner
+// by default. The publisher holds an flock on the segment while it lives, which the kernel drops
+// when it dies, even in another pid namespace. A segment nobody holds is replaced, while one whose
+// publisher is still running, or that sargs did not create, makes the constructor throw.
+class SharedPublisher {
+ public:
+  SharedPublisher(Args& args, const std::string& name, const size_t size = 64 * 1024,
+                  const mode_t mode = S_IRUSR | S_IWUSR) : _name(name), _size(size) {
+    if (name.size() < 2 || name[0] != '/' || name.find('/', 1) != std::string::npos)
+      throw SargsError("Invalid shared memory name " + name + ", expected /name");
+    if (size < sizeof(SharedHeader) || size > std::numeric_limits<uint32_t>::max())
+      throw SargsError("Invalid shared memory size " + std::to_string(size));
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, mode);
+    if (fd < 0 && errno == EEXIST) {
+      if (!RemoveStaleSegment(name))
+        throw SargsError("Shared memory " + name + " is already in use");
+      fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, mode);
+    }
+    if (fd < 0)
+      throw SargsError("Could not create shared memory " + name);
+    // Locked before the header is written, so the empty segment never looks stale to others
+    void* segment = MAP_FAILED;
+    if (flock(fd, LOCK_EX | LOCK_NB) == 0 && fchmod(fd, mode) == 0 &&
+        ftruncate(fd, static_cast<off_t>(size)) == 0)
+      segment = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (segment == MAP_FAILED) {
+      close(fd);
+      shm_unlink(name.c_str());
+      throw SargsError("Could not map shared memory " + name);
+    }
+    _fd = fd;
+
+    // Readers that open the segment before the first publish see an odd sequence and wait
+    _segment = static_cast<char*>(segment);
+    _header = new (_segment) SharedHeader();
+    _header->sequence.store(1, std::memory_order_relaxed);
+    _header->magic = kSharedMagic;
+    _header->version = kSharedVersion;
+    _header->segment_size = size;
+    _header->publisher = static_cast<uint32_t>(getpid());
+    // A configuration that doesn't fit is kept out of the segment, not out of the program
+    args.AddInitializeHook([this](const Args& parsed) {
+      if (!parsed.GetError().empty())
+        return;
+      try {
+        this->Publish(parsed);
+        _error.clear();
+      } catch (const SargsError& error) {
+        _error = error.what();
+      }
+    });
+  }
+
+  SharedPublisher(const SharedPublisher&) = delete;
+  SharedPublisher& operator=(const SharedPublisher&) = delete;
+
+  ~SharedPublisher() {
+    munmap(_segment, _size);
+    shm_unlink(_name.c_str());
+    close(_fd);
+  }
+
+  // Why the last initialization of args was not published, or empty if it was. Readers keep
+  // seeing the configuration published before.
+  const std::string& GetError() const {
+    return _error;
+  }
+
+  // Writes the state of an initialized Args. The payload is built first, so readers retry only
+  // while it is copied into the segment. Throws SargsError if it doesn't fit.
+  void Publish(const Args& args) {
+    std::vector<FlagState> states = args.Inspect();
+    std::vector<std::pair<std::string, size_t>> names;
+    for (size_t i = 0; i < states.size(); ++i) {
+      for (const std::string* name : { &states[i].flag, &states[i].alias }) {
+        if (!name->empty())
+          names.emplace_back(*name, i);
+      }
+    }
+    std::sort(names.begin(), names.end());
+    const std::vector<std::string> nonflags = args.GetNonFlags();
+
+    // Tables first, then the strings they point to
+    const size_t flag_table = sizeof(SharedHeader);
+    const size_t nonflag_table = flag_table + names.size() * sizeof(SharedFlag);
+    std::string payload(nonflag_table + nonflags.size() * sizeof(SharedString) - flag_table, '\0');
+    const auto append = [&payload, flag_table](const std::string& text) {
+      const SharedString shared = { static_cast<uint32_t>(flag_table + payload.size()),
+                                    static_cast<uint32_t>(text.size()) };
+      payload += text;
+      return shared;
+    };
+    for (size_t i = 0; i < names.size(); ++i) {
+      const FlagState& state = states[names[i].second];
+      // A flag without a value given by its alias is only recorded under the alias
+      const bool has = args.Has(names[i].first);
+      const ValueSource source =
+        (has && state.source == ValueSource::kUnset) ? ValueSource::kCommandLine : state.source;
+      SharedFlag flag = { append(names[i].first), append(state.value), has, static_cast<uint32_t>(source) };
+      std::memcpy(&payload[i * sizeof(SharedFlag)], &flag, sizeof(flag));
+    }
+    for (size_t i = 0; i < nonflags.size(); ++i) {
+      const SharedString nonflag = append(nonflags[i]);
+      std::memcpy(&payload[nonflag_table - flag_table + i * sizeof(SharedString)], &nonflag, sizeof(nonflag));
+    }
+    if (flag_table + payload.size() > _size) {
+      throw SargsError("Configuration of " + std::to_string(flag_table + payload.size()) +
+                       " bytes does not fit in shared memory " + _name + " of " +
+                       std::to_string(_size) + " bytes");
+    }
+
+    const uint64_t sequence = _header->sequence.load(std::memory_order_relaxed) | 1;
+    _header->sequence.store(sequence, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _header->fingerprint = args.Fingerprint();
+    _header->used = static_cast<uint32_t>(flag_table + payload.size());
+    _header->flag_count = static_cast<uint32_t>(names.size());
+    _header->flag_table = static_cast<uint32_t>(flag_table);
+    _header->nonflag_count = static_cast<uint32_t>(nonflags.size());
+    _header->nonflag_table = static_cast<uint32_t>(nonflag_table);
+    std::memcpy(_segment + flag_table, payload.data(), payload.size());
+    _header->sequence.store(sequence + 1, std::memory_order_release);
+  }
+
+ private:
+  std::string _name;
+  size_t _size;
+  int _fd = -1;
+  char* _segment = nullptr;
+  SharedHeader* _header = nullptr;
+  std::string _error;
+
+  // Unlinks a segment of the current user holding a sargs header whose lock no publisher holds,
+  // and returns whether it did. The lock is kept until the name is gone, and the name must still
+  // refer to the locked segment, so a segment another process just created in its place survives.
+  static bool RemoveStaleSegment(const std::string& name) {
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+      return false;
+    struct stat status;
+    void* segment = MAP_FAILED;
+    if (fstat(fd, &status) == 0 && status.st_uid == geteuid() &&
+        static_cast<size_t>(status.st_size) >= sizeof(SharedHeader) &&
+        flock(fd, LOCK_EX | LOCK_NB) == 0)
+      segment = mmap(nullptr, sizeof(SharedHeader), PROT_READ, MAP_SHARED, fd, 0);
+    bool stale = false;
+    if (segment != MAP_FAILED) {
+      stale = static_cast<const SharedHeader*>(segment)->magic == kSharedMagic;
+      munmap(segment, sizeof(SharedHeader));
+    }
+    if (stale) {
+      const int current = shm_open(name.c_str(), O_RDONLY, 0);
+      struct stat current_status;
+      stale = current >= 0 && fstat(current, &current_status) == 0 &&
+        current_status.st_dev == status.st_dev && current_status.st_ino == status.st_ino;
+      if (current >= 0)
+        close(current);
+    }
+    stale = stale && shm_unlink(name.c_str()) == 0;
+    close(fd);
+    return stale;
+  }
+};
+
+// Reads a configuration published by SharedPublisher, possibly from another process. The segment
+// is mapped read-only and copied by Refresh(), and getters look names up in the copy, so they parse
+// nothing and always agree with each other. Getters may run on many threads, but not during Refresh().
+class SharedArgs {
+ public:
+  explicit SharedArgs(const std::string& name) : _name(name) {
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+      throw SargsError("Could not open shared memory " + name);
+    struct stat status;
+    void* segment = MAP_FAILED;
+    if (fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(SharedHeader)) {
+      _size = static_cast<size_t>(status.st_size);
+      segment = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (segment == MAP_FAILED)
+      throw SargsError("Could not map shared memory " + name);
+    _segment = static_cast<const char*>(segment);
+    _header = reinterpret_cast<const SharedHeader*>(_segment);
+    if (_header->magic != kSharedMagic || _header->version != kSharedVersion) {
+      munmap(const_cast<char*>(_segment), _size);
+      throw SargsError("Shared memory " + name + " does not hold a sargs configuration of version " +
+                       std::to_string(kSharedVersion));
+    }
+    try {
+      this->Refresh();
+    } catch (...) {
+      munmap(const_cast<char*>(_segment), _size);
+      throw;
+    }
+  }
+
+  SharedArgs(const SharedArgs&) = delete;
+  SharedArgs& operator=(const SharedArgs&) = delete;
+
+  ~SharedArgs() {
+    munmap(const_cast<char*>(_segment), _size);
+  }
+
+  // Copies the segment again if the publisher published since the last copy, and returns whether
+  // it did. Waits for a publish in progress, and gives up after a while in case the publisher died
+  // halfway, keeping the last copy.
+  bool Refresh() {
+    const uint64_t current = _header->sequence.load(std::memory_order_acquire);
+    if (current == _sequence && !_copy.empty())
+      return false;
+
+    std::string copy;
+    for (int attempt = 0; attempt < 100000; ++attempt) {
+      const uint64_t before = _header->sequence.load(std::memory_order_acquire);
+      if ((before & 1) == 0) {
+        const SharedHeader* header = reinterpret_cast<const SharedHeader*>(_segment);
+        const size_t used = std::min<size_t>(header->used, _size);
+        copy.assign(_segment, std::max(used, sizeof(SharedHeader)));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_header->sequence.load(std::memory_order_relaxed) == before) {
+          this->Validate(copy);
+          _copy.swap(copy);
+          _sequence = before;
+          return true;
+        }
+      }
+      if (attempt > 100)
+        std::this_thread::yield();
+    }
+    if (_copy.empty())
+      throw SargsError("Shared memory " + _name + " was not published");
+    return false;
+  }
+
+  // Even number that grows by 2 with every publish
+  uint64_t Sequence() const {
+    return _sequence;
+  }
+
+  uint64_t Fingerprint() const {
+    return this->Header().fingerprint;
+  }
+
+  bool Has(const std::string& flag) const {
+    SharedFlag entry;
+    return this->Find(flag, entry) && entry.has != 0;
+  }
+
+  bool GetAsString(const std::string& flag, std::string& value) const {
+    SharedFlag entry;
+    if (!this->Find(flag, entry) || entry.has == 0)
+      return false;
+    value = this->Text(entry.value);
+    return true;
+  }
+
+  std::string GetAsString(const std::string& flag) const {
+    std::string value;
+    if (!this->GetAsString(flag, value))
+      throw SargsError(flag + " was not specified");
+    return value;
+  }
+
+  int64_t GetAsInt64(const std::string& flag) const {
+    const std::string value = this->GetAsString(flag);
+    errno = 0;
+    const int64_t number = std::strtoll(value.c_str(), nullptr, 0);
+    if (errno == ERANGE)
+      throw SargsError("Could not convert " + value + " to int64_t");
+    return number;
+  }
+
+  uint64_t GetAsUInt64(const std::string& flag) const {
+    const std::string value = this->GetAsString(flag);
+    errno = 0;
+    const uint64_t number = std::strtoull(value.c_str(), nullptr, 0);
+    if (errno == ERANGE)
+      throw SargsError("Could not convert " + value + " to uint64_t");
+    return number;
+  }
+
+  float GetAsFloat(const std::string& flag) const {
+    const std::string value = this->GetAsString(flag);
+    errno = 0;
+    const float number = std::strtof(value.c_str(), nullptr);
+    if (errno == ERANGE)
+      throw SargsError("Could not convert " + value + " to float");
+    return number;
+  }
+
+  ValueSource Source(const std::string& flag) const {
+    SharedFlag entry;
+    return this->Find(flag, entry) ? static_cast<ValueSource>(entry.source) : ValueSource::kUnset;
+  }
+
+  std::vector<std::string> GetNonFlags() const {
+    std::vector<std::string> nonflags;
+    const SharedHeader& header = this->Header();
+    for (uint32_t i = 0; i < header.nonflag_count; ++i) {
+      SharedString nonflag;
+      std::memcpy(&nonflag, &_copy[header.nonflag_table + i * sizeof(SharedString)], sizeof(nonflag));
+      nonflags.push_back(this->Text(nonflag));
+    }
+    return nonflags;
+  }
+
+ private:
+  std::string _name;
+  size_t _size = 0;
+  const char* _segment = nullptr;
+  const SharedHeader* _header = nullptr;
+  std::string _copy;
+  uint64_t _sequence = 0;
+
+  // The copy of the header, whose sequence is not read
+  const SharedHeader& Header() const {
+    return *reinterpret_cast<const SharedHeader*>(_copy.data());
+  }
+
+  std::string Text(const SharedString& text) const {
+    return _copy.substr(text.offset, text.size);
+  }
+
+  // Checks every offset once per copy, so getters can trust them
+  void Validate(const std::string& copy) const {
+    const SharedHeader& header = *reinterpret_cast<const SharedHeader*>(copy.data());
+    const auto fits = [&copy](const uint64_t offset, const uint64_t size) {
+      return offset + size <= copy.size();
+    };
+    bool valid = fits(header.flag_table, uint64_t(header.flag_count) * sizeof(SharedFlag)) &&
+                 fits(header.nonflag_table, uint64_t(header.nonflag_count) * sizeof(SharedString));
+    for (uint32_t i = 0; valid && i < header.flag_count; ++i) {
+      SharedFlag flag;
+      std::memcpy(&flag, &copy[header.flag_table + i * sizeof(SharedFlag)], sizeof(flag));
+      valid = fits(flag.name.offset, flag.name.size) && fits(flag.value.offset, flag.value.size);
+    }
+    for (uint32_t i = 0; valid && i < header.nonflag_count; ++i) {
+      SharedString nonflag;
+      std::memcpy(&nonflag, &copy[header.nonflag_table + i * sizeof(SharedString)], sizeof(nonflag));
+      valid = fits(nonflag.offset, nonflag.size);
+    }
+    if (!valid)
+      throw SargsError("Shared memory " + _name + " is corrupt");
+  }
+
+  // Binary search of the sorted names
+  bool Find(const std::string& flag, SharedFlag& entry) const {
+    const SharedHeader& header = this->Header();
+    size_t low = 0;
+    size_t high = header.flag_count;
+    while (low < high) {
+      const size_t middle = (low + high) / 2;
+      std::memcpy(&entry, &_copy[header.flag_table + middle * sizeof(SharedFlag)], sizeof(entry));
+      const int order = _copy.compare(entry.name.offset, entry.name.size, flag);
+      if (order == 0)
+        return true;
+      if (order < 0)
+        low = middle + 1;
+      else
+        high = middle;
+    }
+    return false;
+  }
+};
+
+}  // namespace sargs
+
+// Publishes the configuration of the current instance to the named shared memory segment after
+// every Initialize(). Use before SARGS_INITIALIZE().
+#define SARGS_PUBLISH_SHARED(name) \
+  static sargs::SharedPublisher sargs_shared_publisher(sargs::Args::Current(), name)
@@ -0,0 +1,281 @@
+//
+// Copyright (c) 2017-2021 Daniel Ali. All rights reserved.
+// See LICENSE for details.
+//
+#pragma once
+
+#include "sargs.h"
+
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__) && !defined(SARGS_DISABLE_PATCHING)
+#define SARGS_PATCHED_STATIC_FLAGS 1
+#include <atomic>
+#include <mutex>
+#include <csignal>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+#else
+#define SARGS_PATCHED_STATIC_FLAGS 0
+#include <atomic>
+#endif
+
+namespace sargs {
+
+// One check site of a static flag: the address of its 5 byte instruction, the code to run when
+// enabled and the code that reads the flag while the site is not patched
+struct JumpEntry {
+  uintptr_t code;
+  uintptr_t target;
+  uintptr_t fallback;
+};
+
+// State of a boolean flag whose checks are patched into the code, like kernel static keys. Every
+// check site starts as a 5 byte JMP to a plain check of Enabled(), and the first Set() rewrites it
+// to a NOP that falls through to the disabled path or to a JMP to the enabled path. Sites are
+// rewritten the way the kernel does it, so threads may run them while Initialize() patches: an
+// int3 replaces the first byte, then the rest of the instruction, then the first byte again, and
+// every core is serialized with membarrier() between the steps. A thread hitting the int3 runs the
+// site again until it is patched. Processes that can't map code writable, or kernels without
+// membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE), keep the plain checks.
+class StaticFlag {
+ public:
+  StaticFlag() = default;
+
+  StaticFlag(JumpEntry* begin, JumpEntry* end) : _begin(begin), _end(end) {}
+
+  StaticFlag(const StaticFlag&) = delete;
+  StaticFlag& operator=(const StaticFlag&) = delete;
+
+  bool Enabled() const {
+    return _enabled.load(std::memory_order_relaxed);
+  }
+
+  // Whether the check sites are patched instead of reading Enabled()
+  bool Patched() const {
+    return _patched;
+  }
+
+  void Set(const bool enabled) {
+    // Unpatched sites read the value, so it changes first
+    _enabled.store(enabled, std::memory_order_relaxed);
+#if SARGS_PATCHED_STATIC_FLAGS
+    std::lock_guard<std::mutex> lock(PatchMutex());
+    if (_begin == _end || (_patched && _patched_enabled == enabled) || !CanPatch())
+      return;
+    if (!this->Patch(enabled) && _patched)
+      throw SargsError("Could not make static flag check site writable");
+#endif
+  }
+
+ private:
+  JumpEntry* _begin = nullptr;
+  JumpEntry* _end = nullptr;
+  std::atomic<bool> _enabled{false};
+  bool _patched = false;
+  bool _patched_enabled = false;
+  StaticFlag* _next = nullptr;  // Keys with patched sites, for the trap handler
+
+#if SARGS_PATCHED_STATIC_FLAGS
+  static std::mutex& PatchMutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  static std::atomic<StaticFlag*>& PatchedKeys() {
+    static std::atomic<StaticFlag*> keys{nullptr};
+    return keys;
+  }
+
+  static struct sigaction& PreviousTrap() {
+    static struct sigaction previous;
+    return previous;
+  }
+
+  // membarrier() commands, which linux/membarrier.h declares as enumerators
+  static const int kSyncCores = 1 << 5;
+  static const int kRegisterSyncCores = 1 << 6;
+
+  // Registers for serializing every core once and installs the trap handler. Called under the mutex
+  static bool CanPatch() {
+#ifdef __NR_membarrier
+    static const bool ready = []() {
+      if (syscall(__NR_membarrier, kRegisterSyncCores, 0) != 0)
+        return false;
+      struct sigaction action;
+      std::memset(&action, 0, sizeof(action));
+      action.sa_sigaction = &StaticFlag::Trap;
+      action.sa_flags = SA_SIGINFO | SA_RESTART;
+      sigemptyset(&action.sa_mask);
+      return sigaction(SIGTRAP, &action, &PreviousTrap()) == 0;
+    }();
+    return ready;
+#else
+    return false;
+#endif
+  }
+
+  static void SyncCores() {
+#ifdef __NR_membarrier
+    syscall(__NR_membarrier, kSyncCores, 0);
+#endif
+  }
+
+  // A thread that hit the int3 of a site being patched runs the site again. The int3 is gone once
+  // the patch is done, so a trap delivered late runs the new instruction. Other traps are passed on.
+  static void Trap(const int number, siginfo_t* info, void* context) {
+    greg_t& rip = static_cast<ucontext_t*>(context)->uc_mcontext.gregs[REG_RIP];
+    const uintptr_t site = static_cast<uintptr_t>(rip) - 1;
+    for (const StaticFlag* key = PatchedKeys().load(std::memory_order_acquire); key != nullptr;
+         key = key->_next) {
+      for (const JumpEntry* entry = key->_begin; entry != key->_end; ++entry) {
+        if (entry->code == site) {
+          rip = static_cast<greg_t>(site);
+          return;
+        }
+      }
+    }
+    const struct sigaction& previous = PreviousTrap();
+    if ((previous.sa_flags & SA_SIGINFO) != 0) {
+      previous.sa_sigaction(number, info, context);
+    } else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+      previous.sa_handler(number);
+    } else {
+      // Delivered with the default action once the handler returns
+      signal(SIGTRAP, SIG_DFL);
+      raise(SIGTRAP);
+    }
+  }
+
+  // Sets the protection of the pages holding the sites, and returns whether every call succeeded
+  bool Protect(const int protection) const {
+    const uintptr_t page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    bool protect = true;
+    for (const JumpEntry* entry = _begin; entry != _end; ++entry) {
+      const uintptr_t first = entry->code & ~(page_size - 1);
+      const size_t length = static_cast<size_t>(entry->code + 5 - first);
+      protect = mprotect(reinterpret_cast<void*>(first), length, protection) == 0 && protect;
+    }
+    return protect;
+  }
+
+  // Rewrites every site, and returns false without touching them if the code can't be made writable
+  bool Patch(const bool enabled) {
+    if (!this->Protect(PROT_READ | PROT_WRITE | PROT_EXEC)) {
+      this->Protect(PROT_READ | PROT_EXEC);
+      return false;
+    }
+    if (!_patched) {
+      _next = PatchedKeys().load(std::memory_order_relaxed);
+      PatchedKeys().store(this, std::memory_order_release);
+    }
+
+    static const uint8_t nop[5] = { 0x0f, 0x1f, 0x44, 0x00, 0x00 };
+    const auto instruction = [enabled](const JumpEntry& entry, uint8_t* code) {
+      if (enabled) {
+        const int32_t offset = static_cast<int32_t>(entry.target - (entry.code + 5));
+        code[0] = 0xe9;
+        std::memcpy(&code[1], &offset, sizeof(offset));
+      } else {
+        std::memcpy(code, nop, 5);
+      }
+    };
+    const auto site = [](const JumpEntry& entry) {
+      return reinterpret_cast<volatile uint8_t*>(entry.code);
+    };
+    for (JumpEntry* entry = _begin; entry != _end; ++entry)
+      *site(*entry) = 0xcc;
+    SyncCores();
+    for (JumpEntry* entry = _begin; entry != _end; ++entry) {
+      uint8_t code[5];
+      instruction(*entry, code);
+      for (size_t i = 1; i < sizeof(code); ++i)
+        site(*entry)[i] = code[i];
+    }
+    SyncCores();
+    for (JumpEntry* entry = _begin; entry != _end; ++entry) {
+      uint8_t code[5];
+      instruction(*entry, code);
+      *site(*entry) = code[0];
+    }
+    SyncCores();
+    _patched = true;
+    _patched_enabled = enabled;
+
+    const bool restored = this->Protect(PROT_READ | PROT_EXEC);
+    for (JumpEntry* entry = _begin; entry != _end; ++entry) {
+      char* begin = reinterpret_cast<char*>(entry->code);
+      __builtin___clear_cache(begin, begin + 5);
+    }
+    if (!restored)
+      throw SargsError("Could not make static flag check site read only again");
+    return true;
+  }
+#endif
+};
+
+// Registers flag as an optional flag and keeps the static flag in sync with it after every Initialize()
+inline void AddOptionalStaticFlag(Args& args, StaticFlag& key, const std::string& flag,
+                                  const std::string& alias, const DescriptionText& description) {
+  args.AddOptionalFlag(flag, alias, description);
+  args.AddInitializeHook([&key, flag](const Args& parsed) { key.Set(parsed.Has(flag)); });
+}
+
+}  // namespace sargs
+
+#if SARGS_PATCHED_STATIC_FLAGS
+
+// Declares the check for a static flag. Use at global scope in a header included wherever the flag
+// is checked. Every inlined check records its JMP in the sargs_flag_<name> section, and the linker
+// provides the bounds of that section to the flag's key.
+#define SARGS_STATIC_FLAG(name) \
+  extern "C" sargs::JumpEntry __start_sargs_flag_##name[] __attribute__((weak, visibility("hidden"))); \
+  extern "C" sargs::JumpEntry __stop_sargs_flag_##name[] __attribute__((weak, visibility("hidden"))); \
+  namespace sargs { namespace static_flags { \
+  inline StaticFlag& name##_key() { \
+    static StaticFlag key(__start_sargs_flag_##name, __stop_sargs_flag_##name); \
+    return key; \
+  } \
+  __attribute__((always_inline)) inline bool name() { \
+    asm goto("1: .byte 0xe9\n\t" \
+             ".long %l[fallback] - 2f\n\t" \
+             "2:\n\t" \
+             ".pushsection sargs_flag_" #name ", \"aw\"\n\t" \
+             ".balign 8\n\t" \
+             ".quad 1b, %l[enabled], %l[fallback]\n\t" \
+             ".popsection" : : : : enabled, fallback); \
+    return false; \
+  enabled: \
+    return true; \
+  fallback: \
+    return name##_key().Enabled(); \
+  } \
+  } }
+
+#else
+
+// Portable fallback: the check is a load of the key's bool
+#define SARGS_STATIC_FLAG(name) \
+  namespace sargs { namespace static_flags { \
+  inline StaticFlag& name##_key() { \
+    static StaticFlag key; \
+    return key; \
+  } \
+  inline bool name() { \
+    return name##_key().Enabled(); \
+  } \
+  } }
+
+#endif
+
+// Tells Sargs that an optional flag declared with SARGS_STATIC_FLAG(name) should be expected. The
+// patched check sites are shared by the whole process, so the flag always belongs to the default
+// instance, even inside a ScopedArgs
+#define SARGS_OPTIONAL_STATIC_FLAG(name, flag, alias, description) \
+  sargs::AddOptionalStaticFlag(sargs::Args::Default(), sargs::static_flags::name##_key(), flag, alias, \
+                               description)
+
+// Return a bool of whether the static flag was specified. Compiles to a patched NOP or JMP on x86-64 Linux
+#define SARGS_STATIC_HAS(name) \
+  sargs::static_flags::name()
@@ -1,6 +1,19 @@
+#define SARGS_ENABLE_PINS
+#define SARGS_COUNT_READS
 #include "sargs.h"
+#include "sargs_admin.h"
+#include "sargs_schema.h"
+#include "sargs_shared.h"
+#include "sargs_static_flag.h"
+#include "test_flags.h"
+#include <regex>
 #include <stdexcept>
 
+SARGS_PIN("--pinned-on", true);
+SARGS_PIN_INT("--lanes", 8);
+SARGS_PIN_INT("--spares", 0);
+SARGS_STATIC_FLAG(test_trace)
+
 using namespace sargs;
 using namespace std;
 
@@ -295,6 +308,1402 @@ void TestBothFlagsAvailable() {
   cout << "pass" << endl;
 }
 
+void TestEnumAndSet() {
+  cout << "TestEnumAndSet()...";
+
+  enum class Mode { kSlow = 3, kFast = 7 };
+
+  Args args;
+  args.DisableExit();
+  args.DisableUsage();
+  args.AddRequiredFlagEnum("--mode", "-m", "The mode", { {"slow", Mode::kSlow}, {"fast", Mode::kFast} });
+  args.AddOptionalFlagSet("--features", "", "Features", { "a", "b", "c" });
+  args.AddOptionalFlagSet("--other", "", "Other features", { "x", "y" }, "y");
+
+  string str1 = "program";
+  string str2 = "-m=fast";
+  string str3 = "--features=c,a";
+  char* argv[3] = { &str1.front(), &str2.front(), &str3.front() };
+  args.Initialize(3, argv);
+
+  Assert(args.GetAsEnum("--mode") == 7);
+  Assert(args.GetAsEnum<Mode>("-m") == Mode::kFast);
+  Assert(args.GetAsBitmask("--features") == 5);
+  Assert(args.GetAsBitmask("--other") == 2);
+  Assert(args.GetFlagDescription().find("(one of: slow, fast)") != string::npos);
+
+  Args bad;
+  bad.DisableExit();
+  bad.DisableUsage();
+  bad.AddRequiredFlagEnum("--mode", "", "The mode", { {"slow", 0}, {"fast", 1} });
+  string str4 = "--mode=medium";
+  char* bad_argv[2] = { &str1.front(), &str4.front() };
+  bad.Initialize(2, bad_argv);
+  Assert(!bad.Has("--help"));
+  int64_t mode = -1;
+  Assert(!bad.GetAsEnum("--mode", mode));
+
+  cout << "pass" << endl;
+}
+
+void TestSweep() {
+  cout << "TestSweep()...";
+
+  Args args;
+  args.DisableExit();
+  args.DisableUsage();
+  args.AddOptionalFlagSweep("--threads", "-t", "Threads");
+  args.AddOptionalFlagSweep("--batch", "", "Batch size");
+  args.AddOptionalFlagSweep("--mode", "", "Mode", "fast");
+
+  string str1 = "program";
+  string str2 = "--threads=1:64:x2";
+  string str3 = "--batch={16,32,64}";
+  char* argv[3] = { &str1.front(), &str2.front(), &str3.front() };
+  args.Initialize(3, argv);
+
+  const Sweep& sweep = args.GetSweep();
+  Assert(sweep.Size() == 7 * 3);
+  Assert(sweep.At(0).GetAsInt64("--threads") == 1);
+  Assert(sweep.At(0).GetAsInt64("--batch") == 16);
+  Assert(sweep.At(1).GetAsInt64("--batch") == 32);
+  Assert(sweep.At(3).GetAsInt64("-t") == 2);
+  Assert(sweep.At(20).GetAsInt64("--threads") == 64);
+  Assert(sweep.At(20).GetAsString("--mode") == "fast");
+
+  size_t visited = 0;
+  for (size_t shard = 0; shard < 4; ++shard) {
+    for (auto point : sweep.Shard(shard, 4)) {
+      Assert(point.Index() % 4 == shard);
+      ++visited;
+    }
+  }
+  Assert(visited == sweep.Size());
+
+  std::vector<std::string> values;
+  Assert(Sweep::Expand("0:10:+5", values) && values.size() == 3 && values[2] == "10");
+  Assert(Sweep::Expand("1:3", values) && values.size() == 3);
+  Assert(!Sweep::Expand("1:64:x1", values));
+  Assert(!Sweep::Expand("{}", values));
+
+  // Ranges are computed on demand and products that do not fit size_t are rejected
+  Args huge;
+  huge.DisableExit();
+  huge.DisableUsage();
+  huge.AddOptionalFlagSweep("--threads", "-t", "Threads");
+  huge.AddOptionalFlagSweep("--batch", "", "Batch size");
+  Args overflow(huge);
+  string str4 = "--threads=0:10000000000";
+  char* huge_argv[2] = { &str1.front(), &str4.front() };
+  huge.Initialize(2, huge_argv);
+  Assert(huge.GetError().empty());
+  Assert(huge.GetSweep().Size() == 10000000001ULL);
+  Assert(huge.GetSweep().At(9999999999ULL).GetAsInt64("--threads") == 9999999999LL);
+  string str5 = "--batch=-9223372036854775807:9223372036854775807:+2";
+  char* overflow_argv[3] = { &str1.front(), &str4.front(), &str5.front() };
+  overflow.Initialize(3, overflow_argv);
+  Assert(overflow.GetError().find("Invalid sweep for --batch") == 0);
+
+  cout << "pass" << endl;
+}
+
+void TestPinned() {
+  cout << "TestPinned()...";
+
+  static_assert(SARGS_HAS("--pinned-on"), "pinned flag must fold to a constant");
+  static_assert(SARGS_GET_INT32("--lanes") == 8, "pinned value must fold to a constant");
+  static_assert(SARGS_HAS("--spares") && SARGS_GET_INT32("--spares") == 0, "a value pinned to 0 is present");
+
+  Args args;
+  args.DisableExit();
+  args.DisableUsage();
+  args.AddOptionalFlag("--pinned-on", "-p", "Pinned flag");
+  args.AddRequiredFlagValue("--lanes", "-l", "Lanes");
+  args.PinFlag("--pinned-on", true);
+  args.PinFlagValue("--lanes", "8");
+
+  string str1 = "program";
+  char* argv[1] = { &str1.front() };
+  args.Initialize(1, argv);
+  Assert(args.Has("-p"));
+  Assert(args.GetAsInt32("-l") == 8);
+  Assert(args.GetFlagDescription().find("[pinned: 8]") != string::npos);
+
+  Args overridden;
+  overridden.DisableExit();
+  overridden.DisableUsage();
+  overridden.AddOptionalFlagValue("--width", "-w", "Width");
+  overridden.PinFlagValue("--width", "4");
+  string str2 = "-w=2";
+  char* override_argv[2] = { &str1.front(), &str2.front() };
+  overridden.Initialize(2, override_argv);
+  Assert(!overridden.Has("--width"));
+  Assert(overridden.GetError() == "-w is pinned at build time and cannot be overridden");
+
+  cout << "pass" << endl;
+}
+
+void TestStaticFlag() {
+  cout << "TestStaticFlag()...";
+
+  Assert(!SARGS_STATIC_HAS(test_trace));
+
+  string str1 = "program";
+  string str2 = "--trace";
+  char* argv[2] = { &str1.front(), &str2.front() };
+
+  Args enabled;
+  AddOptionalStaticFlag(enabled, static_flags::test_trace_key(), "--trace", "-t", "Trace");
+  enabled.Initialize(2, argv);
+  Assert(SARGS_STATIC_HAS(test_trace));
+
+  Args disabled;
+  AddOptionalStaticFlag(disabled, static_flags::test_trace_key(), "--trace", "-t", "Trace");
+  disabled.Initialize(1, argv);
+  Assert(!SARGS_STATIC_HAS(test_trace));
+
+  // Sites are patched while another thread keeps running them
+  atomic<bool> stop(false);
+  atomic<uint64_t> enabled_checks(0);
+  thread checker([&stop, &enabled_checks]() {
+    while (!stop) {
+      if (SARGS_STATIC_HAS(test_trace))
+        ++enabled_checks;
+    }
+  });
+  for (int i = 0; i < 200; ++i)
+    static_flags::test_trace_key().Set(i % 2 == 0);
+  static_flags::test_trace_key().Set(true);
+  while (enabled_checks == 0)
+    std::this_thread::yield();
+  stop = true;
+  checker.join();
+  Assert(SARGS_STATIC_HAS(test_trace));
+  static_flags::test_trace_key().Set(false);
+  Assert(!SARGS_STATIC_HAS(test_trace));
+
+  // The check sites are process-wide, so a scope does not get its own copy of the flag
+  {
+    sargs::ScopedArgs scope;
+    SARGS_OPTIONAL_STATIC_FLAG(test_trace, "--trace", "-t", "Trace");
+    Assert(scope.Get().Inspect().empty());
+  }
+  Assert(sargs::Args::Default().Inspect().size() == 1);
+  Assert(sargs::Args::Default().Inspect()[0].flag == "--trace");
+
+  cout << "pass" << endl;
+}
+
+static uint64_t FingerprintOf(std::vector<string> arguments) {
+  Args args;
+  args.DisableExit();
+  args.DisableUsage();
+  args.AddOptionalFlagNumber("--threads", "-t", "Threads", "4");
+  args.AddOptionalFlagNumber("--scale", "", "Scale");
+  args.AddOptionalFlag("--verbose", "-v", "Verbose");
+  args.AddOptionalFlagEnum("--mode", "", "Mode", { {"slow", 0}, {"fast", 1} }, "slow");
+  args.AddOptionalFlagValue("--version", "", "Version");
+  args.AddOptionalFlagValue("--id", "", "Identifier");
+  args.AddOptionalFlagHex("--key", "", "Key");
+  args.MarkNonSemantic("--verbose");
+
+  arguments.insert(arguments.begin(), "program");
+  std::vector<char*> argv;
+  for (auto& argument : arguments)
+    argv.push_back(&argument.front());
+  args.Initialize(static_cast<int>(argv.size()), argv.data());
+  return args.Fingerprint();
+}
+
+void TestFingerprint() {
+  cout << "TestFingerprint()...";
+
+  const uint64_t base = FingerprintOf({ "--scale=1.0" });
+  Assert(base == FingerprintOf({ "--scale", "1", "-t", "0x4" }));
+  Assert(base == FingerprintOf({ "--threads=4", "--scale=1e0", "-v", "--mode=slow" }));
+  Assert(base != FingerprintOf({ "--scale=1.5" }));
+  Assert(base != FingerprintOf({ "--scale=1.0", "--mode=fast" }));
+  Assert(base != FingerprintOf({ "--scale=1.0", "-t", "8" }));
+
+  // Only number flags are normalized, strings hash verbatim and binary flags by their bytes
+  Assert(FingerprintOf({ "--version=1.10" }) != FingerprintOf({ "--version=1.1" }));
+  Assert(FingerprintOf({ "--id=007" }) != FingerprintOf({ "--id=7" }));
+  Assert(FingerprintOf({ "--key=0x10" }) != FingerprintOf({ "--key=0x0010" }));
+  Assert(FingerprintOf({ "--key=0x10" }) == FingerprintOf({ "--key=10" }));
+
+  Args invalid;
+  invalid.DisableExit();
+  invalid.DisableUsage();
+  invalid.AddOptionalFlagNumber("--scale", "", "Scale");
+  string str1 = "program";
+  string str2 = "--scale=fast";
+  char* argv[2] = { &str1.front(), &str2.front() };
+  invalid.Initialize(2, argv);
+  Assert(invalid.GetError() == "Invalid number for --scale: fast");
+
+  cout << "pass" << endl;
+}
+
+void TestPermissive() {
+  cout << "TestPermissive()...";
+
+  Args args;
+  args.DisableExit();
+  args.DisableUsage();
+  args.EnablePermissive();
+  args.AddOptionalFlag("--verbose", "-v", "Verbose");
+  args.RequireNonFlags(1);
+
+  string str1 = "program";
+  string str2 = "--plugin-level";
+  string str3 = "3";
+  string str4 = "-v";
+  string str5 = "--plugin-fast";
+  string str6 = "input";
+  string str7 = "--plugin-name=alpha";
+  char* argv[7] = { &str1.front(), &str2.front(), &str3.front(), &str4.front(), &str5.front(), &str6.front(),
+                    &str7.front() };
+  args.Initialize(7, argv);
+  Assert(args.Has("--verbose"));
+  Assert(args.GetNonFlags().empty());
+
+  args.AddOptionalFlagValue("--plugin-level", "", "Plugin level");
+  args.AddOptionalFlag("--plugin-fast", "", "Plugin speed");
+  Assert(args.ClaimPending());
+  Assert(args.GetAsInt32("--plugin-level") == 3);
+  Assert(args.Has("--plugin-fast"));
+  Assert(args.GetNonFlags().size() == 1 && args.GetNonFlag(0) == "input");
+  Assert(!args.CheckUnclaimed());
+
+  args.AddRequiredFlagValue("--plugin-name", "-n", "Plugin name");
+  Assert(args.ClaimPending());
+  Assert(args.GetAsString("-n") == "alpha");
+  Assert(args.CheckUnclaimed());
+
+  cout << "pass" << endl;
+}
+
+void TestSharedTokens() {
+  cout << "TestSharedTokens()...";
+
+  string str1 = "program";
+  string str2 = "--db-host=localhost";
+  string str3 = "--cache-size";
+  string str4 = "64";
+  string str5 = "--stray";
+  string str6 = "--";
+  string str7 = "input";
+  char* argv[7] = { &str1.front(), &str2.front(), &str3.front(), &str4.front(), &str5.front(), &str6.front(),
+                    &str7.front() };
+  TokenizedArgv tokens(7, argv);
+
+  Args database;
+  database.DisableHelp();
+  database.AddRequiredFlagValue("--db-host", "", "Database host");
+  database.Bind(tokens);
+  Assert(database.GetAsString("--db-host") == "localhost");
+
+  Args cache;
+  cache.DisableHelp();
+  cache.AddOptionalFlagValue("--cache-size", "", "Cache size");
+  cache.RequireNonFlags(1);
+  cache.Bind(tokens);
+  Assert(cache.GetAsUInt32("--cache-size") == 64);
+  Assert(cache.GetNonFlag(0) == "input");
+  Assert(!database.Has("--cache-size"));
+
+  const std::vector<string> unclaimed = tokens.Unclaimed();
+  Assert(unclaimed.size() == 1 && unclaimed[0] == "--stray");
+
+  cout << "pass" << endl;
+}
+
+void TestScope() {
+  cout << "TestScope()...";
+
+  Args args;
+  args.AddOptionalFlagValue("--db.pool_size", "-p", "Pool size", "8");
+  args.AddOptionalFlagValue("--db.host", "", "Host");
+  args.AddOptionalFlag("--db.replica.enabled", "", "Replica");
+  args.AddOptionalFlagValue("--cache.ttl", "", "Cache ttl");
+  args.AddOptionalFlag("--dbx", "", "Not in the db namespace");
+
+  string str1 = "program";
+  string str2 = "--db.host=primary";
+  string str3 = "--db.replica.enabled";
+  char* argv[3] = { &str1.front(), &str2.front(), &str3.front() };
+  args.Initialize(3, argv);
+
+  ArgsScope db = args.Scope("db");
+  Assert(db.Names().size() == 3);
+  Assert(db.GetAsString("host") == "primary");
+  Assert(db.GetAsInt64("pool_size") == 8);
+  Assert(db.Has("replica.enabled"));
+  Assert(!db.Has("ttl"));
+  Assert(args.Scope("db.replica").Has("enabled"));
+  Assert(args.Scope("cache").Names().size() == 1);
+
+  cout << "pass" << endl;
+}
+
+void TestMap() {
+  cout << "TestMap()...";
+
+  Args args;
+  args.DisableExit();
+  args.DisableUsage();
+  args.AddOptionalFlagMap("--label", "-l", "Labels");
+  args.AddOptionalFlagMap("--tags", "", "Tags");
+
+  string str1 = "program";
+  string str2 = "--label";
+  string str3 = "tenant=acme";
+  string str4 = "-l=zone=us-east,tier:gold";
+  string str5 = "--tags=a:1,b:2,a:3";
+  char* argv[5] = { &str1.front(), &str2.front(), &str3.front(), &str4.front(), &str5.front() };
+  args.Initialize(5, argv);
+
+  const FlatMap& labels = args.GetAsMap("--label");
+  Assert(labels.Size() == 3);
+  Assert(labels.Get("tenant") == "acme");
+  Assert(labels.Get("zone") == "us-east");
+  Assert(args.GetAsMap("-l").Get("tier") == "gold");
+  Assert(!labels.Has("missing"));
+
+  const FlatMap& tags = args.GetAsMap("--tags");
+  Assert(tags.Size() == 2);
+  Assert(tags.Get("a") == "3");
+  Assert(args.GetAsMap("--other").Size() == 0);
+
+  Args bad;
+  bad.DisableExit();
+  bad.DisableUsage();
+  bad.AddOptionalFlagMap("--label", "", "Labels");
+  string str6 = "--label=novalue";
+  char* bad_argv[2] = { &str1.front(), &str6.front() };
+  bad.Initialize(2, bad_argv);
+  Assert(bad.GetAsMap("--label").Size() == 0);
+
+  cout << "pass" << endl;
+}
+
+void TestInitializeAsync() {
+  cout << "TestInitializeAsync()...";
+
+  Args args;
+  args.AddRequiredFlagValue("--threads", "-t", "Threads");
+  args.AddOptionalFlagEnum("--mode", "", "Mode", { {"slow", 0}, {"fast", 1} }, "fast");
+
+  string str1 = "program";
+  string str2 = "-t=12";
+  char* argv[2] = { &str1.front(), &str2.front() };
+  std::shared_future<void> ready = args.InitializeAsync(2, argv);
+  str2 = "-t=99";  // The arguments are copied before InitializeAsync() returns
+
+  Assert(args.GetAsInt32("--threads") == 12);
+  Assert(args.GetAsEnum("--mode") == 1);
+  Assert(ready.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+
+  // A hook running on one worker waits for another pending instance it reads
+  Args other;
+  other.AddRequiredFlagValue("--threads", "-t", "Threads");
+  int32_t seen = 0;
+  Args hooked;
+  hooked.AddOptionalFlag("--verbose", "-v", "Verbose");
+  hooked.AddInitializeHook([&other, &seen](const Args&) { seen = other.GetAsInt32("--threads"); });
+  std::shared_future<void> other_ready = other.InitializeAsync(2, argv);
+  std::shared_future<void> hooked_ready = hooked.InitializeAsync(1, argv);
+  hooked_ready.get();
+  Assert(seen == 99);
+  other_ready.get();
+
+  // Errors are reported by the thread that waits for the result
+  Args invalid;
+  invalid.DisableExit();
+  invalid.DisableUsage();
+  invalid.AddRequiredFlagValue("--level", "-l", "Level");
+  std::shared_future<void> invalid_ready = invalid.InitializeAsync(1, argv);
+  invalid_ready.get();
+  Assert(invalid.GetError() == "Must specify --level");
+
+  // Destroying an instance waits for its worker instead of leaving it writing to freed members
+  atomic<bool> finished(false);
+  {
+    Args abandoned;
+    abandoned.AddOptionalFlag("--verbose", "-v", "Verbose");
+    abandoned.AddInitializeHook([&finished](const Args&) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      finished = true;
+    });
+    abandoned.InitializeAsync(1, argv);
+  }
+  Assert(finished);
+
+  cout << "pass" << endl;
+}
+
+static void RegisterFromArray(Args& args) {
+  const char description[] = "A description kept in a local array";
+  sargs::ScopedArgs scope(args);
+  SARGS_OPTIONAL_FLAG("--local", "-l", description);
+}
+
+void TestFreeze() {
+  cout << "TestFreeze()...";
+
+  Args args;
+  args.DisableExit();
+  args.AddRequiredFlagValue("--threads", "-t", "Worker thread count");
+  args.AddOptionalFlag("--verbose", "-v", "Verbose logging");
+
+  string str1 = "program";
+  string str2 = "-t=4";
+  char* argv[2] = { &str1.front(), &str2.front() };
+  args.Initialize(2, argv);
+  Assert(args.GetFlagDescription().find("Worker thread count") != string::npos);
+
+  args.Freeze();
+  const string usage = args.GetFlagDescription();
+  Assert(usage.find("--threads") != string::npos);
+  Assert(usage.find("--verbose") != string::npos);
+  Assert(usage.find("Worker thread count") == string::npos);
+  Assert(args.GetAsInt32("--threads") == 4);
+
+  args.SetFlagDescription("custom\n");
+  args.AddOptionalFlag("--late", "", "Late flag");
+  Assert(args.GetFlagDescription() == "custom\n");
+
+  // Literals marked with SARGS_LITERAL() are referenced instead of copied
+  Args literals;
+  {
+    sargs::ScopedArgs scope(literals);
+    SARGS_OPTIONAL_FLAG("--verbose", "-v", SARGS_LITERAL("A description long enough to need its own allocation"));
+  }
+  Assert(literals.MemoryUsage().descriptions == 0);
+  Assert(literals.GetFlagDescription().find("A description long") != string::npos);
+  literals.AddOptionalFlag("--quiet", "-q", string("A copied description long enough to need its own allocation"));
+  Assert(literals.MemoryUsage().descriptions > 0);
+
+  // Unmarked arrays may not outlive the call, so they are copied
+  Args arrays;
+  RegisterFromArray(arrays);
+  Assert(arrays.MemoryUsage().descriptions > 0);
+  Assert(arrays.GetFlagDescription().find("A description kept in a local array") != string::npos);
+
+  cout << "pass" << endl;
+}
+
+void TestMemoryUsage() {
+  cout << "TestMemoryUsage()...";
+
+  Args first;
+  first.AddRequiredFlagValue("--connection-pool-size", "-p", "Pool size");
+  Args second;
+  second.AddRequiredFlagValue("--connection-pool-size", "-p", "Pool size");
+  const size_t names = sargs::NameTable::Instance().Size();
+  Args third;
+  third.AddRequiredFlagValue("--connection-pool-size", "-p", "Pool size");
+  Assert(sargs::NameTable::Instance().Size() == names);
+
+  const sargs::Name name("--connection-pool-size");
+  Assert(name == sargs::Name(string("--connection-pool-size")));
+  Assert(name.Id() == sargs::Name("--connection-pool-size").Id());
+  Assert(name != sargs::Name("-p"));
+  Assert(name.View() == "--connection-pool-size");
+
+  string str1 = "program";
+  string str2 = "--connection-pool-size=16";
+  char* argv[2] = { &str1.front(), &str2.front() };
+  third.DisableExit();
+  third.Initialize(2, argv);
+  Assert(third.GetAsInt32("-p") == 16);
+
+  const sargs::MemoryReport report = third.MemoryUsage();
+  Assert(report.registry > 0);
+  Assert(report.values > 0);
+  Assert(report.names > 0);
+  Assert(report.Total() == report.registry + report.descriptions + report.values + report.usage);
+
+  cout << "pass" << endl;
+}
+
+void TestRegistry() {
+  cout << "TestRegistry()...";
+
+  Args args;
+  args.DisableExit();
+  for (int i = 0; i < 100; ++i)
+    args.AddOptionalFlagValue("--option-" + std::to_string(i), "", "Option", std::to_string(i));
+  args.AddRequiredFlagValue("--size", "-s", "Size");
+  args.AddOptionalFlag("--verbose", "-v", "Verbose");
+
+  string str1 = "program";
+  string str2 = "-s";
+  string str3 = "12";
+  string str4 = "--option-42=7";
+  string str5 = "-v";
+  char* argv[5] = { &str1.front(), &str2.front(), &str3.front(), &str4.front(), &str5.front() };
+  args.Initialize(5, argv);
+  Assert(args.GetAsInt32("--size") == 12);
+  Assert(args.GetAsInt32("--option-42") == 7);
+  Assert(args.GetAsInt32("--option-99") == 99);
+  Assert(args.Has("--verbose"));
+  Assert(args.Has("-s"));
+  Assert(!args.Has("--unregistered"));
+  Assert(args.FindAlternative("-v") == "--verbose");
+  Assert(args.FindAlternative("--size") == "-s");
+  Assert(args.FindAlternative("--option-1") == "");
+
+  cout << "pass" << endl;
+}
+
+void TestShortOptions() {
+  cout << "TestShortOptions()...";
+
+  Args args;
+  args.DisableExit();
+  args.DisableUsage();
+  args.AddOptionalFlag("--verbose", "-v", "Verbose");
+  args.AddOptionalFlag("--extract", "-x", "Extract");
+  args.AddOptionalFlag("--force", "-f", "Force");
+  args.AddOptionalFlagValue("--output", "-o", "Output file");
+  args.AddOptionalFlagValue("--parallel", "-p", "Parallelism", "1");
+  args.AddOptionalFlagValue("--level", "-l", "Level", "0");
+  args.RequireNonFlags(1);
+
+  string str1 = "program";
+  string str2 = "-vx";
+  string str3 = "-p2";
+  string str4 = "-fo";
+  string str5 = "out.txt";
+  string str6 = "-l=3";
+  string str7 = "--";
+  string str8 = "-vf";
+  char* argv[8] = { &str1.front(), &str2.front(), &str3.front(), &str4.front(), &str5.front(),
+                    &str6.front(), &str7.front(), &str8.front() };
+  args.Initialize(8, argv);
+  Assert(args.Has("--verbose"));
+  Assert(args.Has("-x"));
+  Assert(args.Has("--force"));
+  Assert(args.GetAsInt32("--parallel") == 2);
+  Assert(args.GetAsString("--output") == "out.txt");
+  Assert(args.GetAsInt32("-l") == 3);
+  Assert(args.GetNonFlags().size() == 1 && args.GetNonFlags()[0] == "-vf");
+
+  Args attached;
+  attached.DisableExit();
+  attached.AddOptionalFlag("--verbose", "-v", "Verbose");
+  attached.AddOptionalFlagValue("--output", "-o", "Output file");
+  string str9 = "-voresult.bin";
+  char* attached_argv[2] = { &str1.front(), &str9.front() };
+  attached.Initialize(2, attached_argv);
+  Assert(attached.Has("-v"));
+  Assert(attached.GetAsString("--output") == "result.bin");
+
+  Args missing;
+  missing.DisableExit();
+  missing.DisableUsage();
+  missing.AddOptionalFlag("--verbose", "-v", "Verbose");
+  missing.AddOptionalFlagValue("--output", "-o", "Output file");
+  string str10 = "-vo";
+  char* missing_argv[2] = { &str1.front(), &str10.front() };
+  missing.Initialize(2, missing_argv);
+  Assert(!missing.Has("-v"));
+  Assert(!missing.Has("--output"));
+
+  cout << "pass" << endl;
+}
+
+void TestCompletion() {
+  cout << "TestCompletion()...";
+
+  Args args;
+  args.DisableExit();
+  args.AddOptionalFlagEnum("--mode", "-m", "Mode", { {"fast", 0}, {"safe", 1}, {"slow", 2} }, "fast");
+  args.AddOptionalFlagSet("--features", "", "Features", { "alpha", "beta" });
+  args.AddOptionalFlagValue("--output", "-o", "Output file");
+  args.AddOptionalFlag("--verbose", "-v", "Verbose");
+
+  const vector<string> flags = args.Complete({ "program", "--" }, 1);
+  Assert(flags.size() == 4);
+  Assert(flags[0] == "--features" && flags[1] == "--mode" && flags[2] == "--output" && flags[3] == "--verbose");
+  Assert(args.Complete({ "program", "--mo" }, 1) == vector<string>({ "--mode" }));
+  Assert(args.Complete({ "program", "--mode=s" }, 1) == vector<string>({ "--mode=safe", "--mode=slow" }));
+  Assert(args.Complete({ "program", "-m", "sl" }, 2) == vector<string>({ "slow" }));
+  Assert(args.Complete({ "program", "-m", "" }, 2).size() == 3);
+  Assert(args.Complete({ "program", "--features=alpha,b" }, 1) == vector<string>({ "--features=alpha,beta" }));
+  Assert(args.Complete({ "program", "-o", "" }, 2).empty());
+  Assert(args.Complete({ "program", "--", "--m" }, 2).empty());
+  Assert(args.Complete({ "program", "file" }, 1).empty());
+
+  string str1 = "/usr/bin/program";
+  string str2 = "--sargs-complete";
+  string str3 = "1";
+  string str4 = "program";
+  string str5 = "--zzz";
+  char* argv[5] = { &str1.front(), &str2.front(), &str3.front(), &str4.front(), &str5.front() };
+  args.Initialize(5, argv);
+  Assert(!args.Has("--sargs-complete"));
+  Assert(args.CompletionScript("bash").find("complete -o default -F _sargs_complete_program program") != string::npos);
+  Assert(args.CompletionScript("zsh").find("#compdef program") == 0);
+
+  cout << "pass" << endl;
+}
+
+void TestSchema() {
+  cout << "TestSchema()...";
+
+  Args args;
+  args.AddRequiredFlagValue("--threads", "-t", "Worker \"threads\"");
+  args.AddOptionalFlag("--verbose", "-v", "Verbose");
+  args.AddOptionalFlagEnum("--mode", "-m", "Mode", { {"fast", 4}, {"safe", 8} }, "safe");
+  args.AddOptionalFlagSet("--features", "", "Features", { "alpha", "beta" });
+  args.AddOptionalFlagMap("--label", "", "Labels");
+  args.AddOptionalFlagSweep("--batch", "", "Batch sizes", "1");
+  args.PinFlagValue("--lanes", "8");
+  args.RequireNonFlags(1);
+
+  const string schema = args.Schema();
+  Args loaded = sargs::LoadSchema(schema);
+  Assert(loaded.Schema() == schema);
+
+  loaded.DisableExit();
+  loaded.DisableUsage();
+  string str1 = "program";
+  string str2 = "-t=4";
+  string str3 = "--mode=fast";
+  string str4 = "input";
+  char* argv[4] = { &str1.front(), &str2.front(), &str3.front(), &str4.front() };
+  Args valid(loaded);
+  valid.Initialize(4, argv);
+  Assert(valid.GetError().empty());
+  Assert(valid.GetAsEnum("--mode") == 4);
+
+  str3 = "--mode=slow";
+  Args invalid(loaded);
+  invalid.Initialize(4, argv);
+  Assert(invalid.GetError() == "Invalid value for --mode: slow");
+
+  // Settings travel with the schema, so a program without help rejects --help when validated
+  Args strict;
+  strict.DisableHelp();
+  strict.EnableHardened();
+  strict.AddOptionalFlag("--verbose", "-v", "Verbose");
+  Args strict_loaded = sargs::LoadSchema(strict.Schema());
+  Assert(strict_loaded.Schema() == strict.Schema());
+  Assert(strict_loaded.GetLimits().max_tokens == sargs::ParseLimits::Hardened().max_tokens);
+  strict_loaded.DisableExit();
+  strict_loaded.DisableUsage();
+  string help = "--help";
+  char* help_argv[2] = { &str1.front(), &help.front() };
+  Args rejected(strict_loaded);
+  rejected.Initialize(2, help_argv);
+  Assert(!rejected.GetError().empty() && rejected.GetError().find("--help") != string::npos);
+  strict.EnablePermissive();
+  Assert(sargs::LoadSchema(strict.Schema()).Schema().find("\"permissive\": true") != string::npos);
+  Assert(schema.find("\"help\": true") != string::npos);
+
+  bool threw = false;
+  try {
+    sargs::LoadSchema("{\"flags\": [}");
+  } catch (sargs::SargsError&) {
+    threw = true;
+  }
+  Assert(threw);
+
+  cout << "pass" << endl;
+}
+
+void TestAdmin() {
+  cout << "TestAdmin()...";
+
+  Args args;
+  args.DisableExit();
+  args.AddRequiredFlagValue("--threads", "-t", "Threads");
+  args.AddOptionalFlagValue("--mode", "", "Mode", "fast");
+  args.AddOptionalFlag("--verbose", "-v", "Verbose");
+
+  string str1 = "program";
+  string str2 = "-t=8";
+  char* argv[2] = { &str1.front(), &str2.front() };
+  args.Initialize(2, argv);
+  Assert(args.GetAsInt32("--threads") == 8);
+  Assert(args.GetAsInt32("-t") == 8);
+  Assert(args.GetAsString("--mode") == "fast");
+
+  const vector<sargs::FlagState> states = args.Inspect();
+  Assert(states.size() == 4);
+  Assert(states[0].flag == "--threads" && states[0].value == "8");
+  Assert(states[0].source == sargs::ValueSource::kCommandLine);
+  Assert(states[0].reads == 2);
+  Assert(states[1].flag == "--mode" && states[1].source == sargs::ValueSource::kFallback && states[1].reads == 1);
+  Assert(states[2].source == sargs::ValueSource::kUnset && states[2].reads == 0);
+  Assert(args.Timings().count == 1);
+  Assert(args.Timings().total >= args.Timings().parse);
+
+  Assert(sargs::AnswerAdminQuery(args, "flags").find("--threads = 8 (command line), 2 reads\n") == 0);
+  Assert(sargs::AnswerAdminQuery(args, "reads json") ==
+         "{\"flags\": [{\"flag\": \"--threads\", \"alias\": \"-t\", \"reads\": 2}, "
+         "{\"flag\": \"--mode\", \"alias\": \"\", \"reads\": 1}, "
+         "{\"flag\": \"--verbose\", \"alias\": \"-v\", \"reads\": 0}, "
+         "{\"flag\": \"--help\", \"alias\": \"-h\", \"reads\": 0}]}\n");
+  Assert(sargs::AnswerAdminQuery(args, "memory").find("names: ") != string::npos);
+  Assert(sargs::AnswerAdminQuery(args, "bogus").find("Commands:") == 0);
+
+  const string path = "/tmp/sargs_test_admin_" + std::to_string(getpid());
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  // A socket file left behind by a crashed server is replaced
+  const int stale = socket(AF_UNIX, SOCK_STREAM, 0);
+  Assert(bind(stale, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+  close(stale);
+  {
+    sargs::AdminServer server(args, path);
+    struct stat status;
+    Assert(stat(path.c_str(), &status) == 0 && (status.st_mode & 0777) == 0600);
+    const int client = socket(AF_UNIX, SOCK_STREAM, 0);
+    Assert(connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+    const string query = "timings\n";
+    Assert(write(client, query.data(), query.size()) == static_cast<ssize_t>(query.size()));
+    string answer;
+    char buffer[256];
+    ssize_t size = 0;
+    while ((size = read(client, buffer, sizeof(buffer))) > 0)
+      answer.append(buffer, static_cast<size_t>(size));
+    close(client);
+    Assert(answer.find("initializations: 1\n") == 0);
+  }
+  Assert(access(path.c_str(), F_OK) != 0);
+
+  // Queries may keep running while the instance is initialized again
+  atomic<bool> reloading(true);
+  atomic<int> answered(0);
+  thread querier([&args, &reloading, &answered]() {
+    while (reloading) {
+      if (sargs::AnswerAdminQuery(args, "all").find("--threads = 8") != string::npos)
+        ++answered;
+    }
+  });
+  for (int i = 0; i < 200; ++i)
+    args.Initialize(2, argv);
+  reloading = false;
+  querier.join();
+  Assert(answered > 0 && args.Timings().count == 201);
+
+  cout << "pass" << endl;
+}
+
+void TestLimits() {
+  cout << "TestLimits()...";
+
+  auto make_args = [](Args& args) {
+    args.DisableExit();
+    args.DisableUsage();
+    args.AddOptionalFlagValue("--level", "-l", "Level", "0");
+    args.AddOptionalFlag("--verbose", "-v", "Verbose");
+    args.AddOptionalFlagSweep("--threads", "-t", "Threads", "1");
+  };
+  auto run = [](Args& args, vector<string> storage) {
+    storage.insert(storage.begin(), "program");
+    vector<char*> argv;
+    for (auto& arg : storage)
+      argv.push_back(&arg.front());
+    args.Initialize(static_cast<int>(argv.size()), argv.data());
+    return args.GetError();
+  };
+
+  sargs::ParseLimits limits;
+  limits.max_tokens = 3;
+  limits.max_token_length = 16;
+  limits.max_total_bytes = 32;
+  limits.max_repetitions = 2;
+  limits.max_steps = 16;
+
+  Args args;
+  make_args(args);
+  args.SetLimits(limits);
+  Assert(run(args, { "-l=3", "-v" }).empty());
+  Assert(args.GetAsInt32("--level") == 3);
+  Assert(run(args, { "-v", "-v", "-v", "-v" }) == "More than 3 arguments");
+  Assert(run(args, { "--level=1234567890" }) == "Argument 1 is longer than 16 bytes");
+  Assert(run(args, { "-l=12345678", "-l=12345678", "-l=12345678" }) == "Arguments are longer than 32 bytes");
+  Assert(run(args, { "-v", "-v", "-v" }) == "-v is repeated more than 2 times");
+  Assert(run(args, { "-v", "-vv" }) == "-v is repeated more than 2 times");
+  Assert(run(args, { "-vvv" }) == "-v is repeated more than 2 times");
+  Assert(run(args, { "--threads=1:8" }).empty());
+  Assert(args.GetSweep().Size() == 8);
+  Assert(run(args, { "--threads=1:99" }).empty());
+  Assert(args.GetSweep().Size() == 99);
+  Args few_steps;
+  make_args(few_steps);
+  limits.max_steps = 4;
+  few_steps.SetLimits(limits);
+  Assert(run(few_steps, { "-t={1,2,3,4,5,6}" }) == "Exceeded the limit of 4 parse steps");
+
+  // A description longer than a line used to hang the wrapping when it ended in blanks
+  Args usage;
+  usage.DisableExit();
+  usage.AddOptionalFlag("--wide", "-w", string(200, 'x') + "  words and more words" + string(300, ' '));
+  stringstream output;
+  usage.PrintUsage(output);
+  Assert(output.str().find("words and more words") != string::npos);
+
+  Args hardened;
+  make_args(hardened);
+  hardened.EnableHardened();
+  Assert(hardened.GetLimits().max_tokens == 1024);
+  Assert(!run(hardened, { "--sargs-dump-schema" }).empty());
+
+  cout << "pass" << endl;
+}
+
+// Reads flags only through the macros, like application code
+static string Greeting() {
+  return SARGS_GET_STRING("--what") + " x" + to_string(SARGS_GET_INT32("--times"));
+}
+
+void TestScopedArgs() {
+  cout << "TestScopedArgs()...";
+
+  Assert(&sargs::Args::Current() == &sargs::Args::Default());
+
+  vector<string> greetings(8);
+  vector<thread> threads;
+  for (size_t i = 0; i < greetings.size(); ++i) {
+    threads.emplace_back([i, &greetings]() {
+      sargs::ScopedArgs scope;
+      SARGS_DISABLE_EXIT();
+      SARGS_REQUIRED_FLAG_VALUE("--what", "-w", "What to greet");
+      SARGS_OPTIONAL_FLAG_VALUE_DEFAULT("--times", "-t", "Repetitions", "1");
+      string str1 = "program";
+      string str2 = "--what=thread" + to_string(i);
+      string str3 = "-t=" + to_string(i);
+      char* argv[3] = { &str1.front(), &str2.front(), &str3.front() };
+      SARGS_INITIALIZE(3, argv);
+      greetings[i] = Greeting();
+    });
+  }
+  for (auto& worker : threads)
+    worker.join();
+  for (size_t i = 0; i < greetings.size(); ++i)
+    Assert(greetings[i] == "thread" + to_string(i) + " x" + to_string(i));
+
+  Args outer;
+  outer.AddOptionalFlag("--outer", "", "Outer");
+  {
+    sargs::ScopedArgs first(outer);
+    Assert(&sargs::Args::Current() == &outer);
+    {
+      sargs::ScopedArgs second;
+      Assert(&sargs::Args::Current() == &second.Get());
+    }
+    Assert(&sargs::Args::Current() == &outer);
+  }
+  Assert(&sargs::Args::Current() == &sargs::Args::Default());
+
+  cout << "pass" << endl;
+}
+
+void TestHelpGroups() {
+  cout << "TestHelpGroups()...";
+
+  Args args;
+  args.DisableExit();
+  args.DisableUsage();
+  args.AddOptionalFlag("--verbose", "-v", "Verbose logging");
+  args.SetGroup("Database");
+  args.AddRequiredFlagValue("--db.host", "", "Database host");
+  args.AddOptionalFlagValue("--db.pool", "", "Connection pool size", "8");
+  args.SetGroup("Cache");
+  args.AddOptionalFlagValue("--cache.ttl", "", "Seconds before an entry expires", "60");
+  args.SetGroup("");
+  args.AddOptionalFlag("--dry-run", "", "Print the plan without applying it");
+
+  string str1 = "program";
+  string str2 = "--help=database";
+  char* argv[2] = { &str1.front(), &str2.front() };
+  args.Initialize(2, argv);
+  Assert(args.Has("--help"));
+
+  stringstream full;
+  args.PrintUsage(full);
+  const string usage = full.str();
+  // Required flags of a group stay under its heading and are marked
+  Assert(usage.find("Required flags") == string::npos);
+  Assert(usage.find("Database host (required)\n") != string::npos);
+  Assert(usage.find("Connection pool size\n") != string::npos);
+  Assert(usage.find("  Optional flags:\n    --verbose") != string::npos);
+  Assert(usage.find("--dry-run") < usage.find("  Database:\n    --db.host=value"));
+  Assert(usage.find("  Database:") < usage.find("  Cache:\n    --cache.ttl=value"));
+
+  stringstream group;
+  args.PrintUsage(group, "DATABASE");
+  Assert(group.str().find("  Database:\n    --db.host=value") == 1);
+  Assert(group.str().find("--db.pool") != string::npos);
+  Assert(group.str().find("Database host (required)\n") != string::npos);
+  Assert(group.str().find("--verbose") == string::npos);
+  Assert(group.str().find("  Groups: Database, Cache\n") != string::npos);
+
+  stringstream matching;
+  args.PrintUsage(matching, "EXPIRES");
+  Assert(matching.str().find("  Flags matching \"EXPIRES\":\n    --cache.ttl") == 1);
+  Assert(matching.str().find("--db.host") == string::npos);
+
+  stringstream host;
+  args.PrintUsage(host, "host");
+  Assert(host.str().find("Database host (required)\n") != string::npos);
+
+  stringstream none;
+  args.PrintUsage(none, "nothing");
+  Assert(none.str().find("No flags match \"nothing\"") == 0);
+
+  Assert(args.Schema().find("\"group\": \"Cache\"") != string::npos);
+  const string schema = args.Schema();
+  const string loaded = sargs::LoadSchema(schema).Schema();
+  Assert(loaded.substr(loaded.find("\"flags\"")) == schema.substr(schema.find("\"flags\"")));
+
+  // Filtered help ignores missing required flags but not other errors
+  auto help = [](const string& filter, const string& extra) {
+    Args printed;
+    printed.DisableExit();
+    printed.AddRequiredFlagValue("--db.host", "", "Database host");
+    printed.AddOptionalFlag("--verbose", "-v", "Verbose logging");
+    string str1 = "program";
+    string str2 = "--help=" + filter;
+    string str3 = extra;
+    char* argv[3] = { &str1.front(), &str2.front(), &str3.front() };
+    stringstream output;
+    std::streambuf* previous = cout.rdbuf(output.rdbuf());
+    printed.Initialize(extra.empty() ? 2 : 3, argv);
+    cout.rdbuf(previous);
+    return output.str();
+  };
+  Assert(help("verbose", "").find("  Flags matching \"verbose\":\n    --verbose") == 1);
+  Assert(help("verbose", "").find("Error:") == string::npos);
+  Assert(help("verbose", "--bogus").find("Error: ") != string::npos);
+  Assert(help("verbose", "--bogus").find("Usage: ") == 0);
+
+  cout << "pass" << endl;
+}
+
+void TestSuggestions() {
+  cout << "TestSuggestions()...";
+
+  auto distance = [](const string& pattern, const string& text) {
+    return sargs::EditDistance(pattern).To(text.data(), text.size());
+  };
+  Assert(distance("kitten", "sitting") == 3);
+  Assert(distance("--threads", "--threads") == 0);
+  Assert(distance("--treads", "--threads") == 1);
+  Assert(distance("--verbose", "") == 9);
+  Assert(distance("ab", "ba") == 2);
+  Assert(distance(string(64, 'a'), string(60, 'a') + "bbbb") == 4);
+  Assert(!sargs::EditDistance("").Valid());
+  Assert(!sargs::EditDistance(string(65, 'a')).Valid());
+
+  Args args;
+  args.DisableExit();
+  args.DisableUsage();
+  args.AddOptionalFlagValue("--threads", "-t", "Threads");
+  args.AddOptionalFlag("--verbose", "-v", "Verbose");
+  args.AddOptionalFlag("--version", "", "Version");
+  for (int i = 0; i < 2000; ++i)
+    args.AddOptionalFlag("--option-" + to_string(i), "", "Filler");
+
+  Assert(args.Suggestions("--treads=4") == vector<string>{ "--threads" });
+  Assert(args.Suggestions("--verison") == vector<string>{ "--version" });
+  Assert(args.Suggestions("--versio")[0] == "--version");
+  Assert(args.Suggestions("--completely-unrelated").empty());
+
+  string str1 = "program";
+  string str2 = "--treads=4";
+  string str3 = "--verbsoe";
+  string str4 = "input.txt";
+  char* argv[4] = { &str1.front(), &str2.front(), &str3.front(), &str4.front() };
+  args.Initialize(4, argv);
+  Assert(args.GetError() ==
+         "Unknown arguments: --treads=4 (did you mean --threads?), --verbsoe (did you mean --verbose or --version?)");
+
+  cout << "pass" << endl;
+}
+
+void TestPattern() {
+  cout << "TestPattern()...";
+
+  const sargs::Pattern host("[a-z0-9]([a-z0-9-]{0,61}[a-z0-9])?(\\.[a-z0-9]([a-z0-9-]{0,61}[a-z0-9])?)*");
+  Assert(host.Matches("db-1.example.com"));
+  Assert(host.Matches("a"));
+  Assert(!host.Matches(""));
+  Assert(!host.Matches("-db.example.com"));
+  Assert(!host.Matches("db..example"));
+  Assert(!host.Matches(string(64, 'a')));
+
+  const sargs::Pattern pair("^\\w+:\\d{1,5}$");
+  Assert(pair.Matches("port:8080"));
+  Assert(!pair.Matches("port:"));
+  Assert(!pair.Matches("port:123456"));
+  Assert(sargs::Pattern("a|b|").Matches(""));
+  Assert(sargs::Pattern("[^,]*").Matches("x y") && !sargs::Pattern("[^,]*").Matches("x,y"));
+  Assert(sargs::Pattern("(ab)+c?").Matches("ababc") && !sargs::Pattern("(ab)+c?").Matches("abac"));
+  Assert(sargs::Pattern("\\.\\*").Matches(".*"));
+
+  // Agrees with std::regex on every string of up to 5 characters over a small alphabet
+  const vector<string> expressions = { "(a|ab)(c|bcd)?", "a*b+a?", "[ab]{2,3}c*", "(a*)*b", "(ab|ba){1,}" };
+  for (const auto& expression : expressions) {
+    const sargs::Pattern pattern(expression);
+    const regex reference(expression);
+    vector<string> texts = { "" };
+    for (size_t i = 0; i < texts.size(); ++i) {
+      Assert(pattern.Matches(texts[i]) == regex_match(texts[i], reference));
+      if (texts[i].size() < 5) {
+        for (const char c : string("abcd"))
+          texts.push_back(texts[i] + c);
+      }
+    }
+  }
+
+  for (const auto& invalid : { "(ab", "ab)", "[a-", "*a", "a{2,1}", "a{300}", "\\q", "(a{200}){200}" }) {
+    bool threw = false;
+    try {
+      sargs::Pattern pattern(invalid);
+    } catch (const SargsError&) {
+      threw = true;
+    }
+    Assert(threw);
+  }
+
+  Args args;
+  args.DisableExit();
+  args.DisableUsage();
+  args.AddRequiredFlagValue("--host", "-H", "Host");
+  args.AddOptionalFlagMap("--label", "-l", "Labels");
+  args.AddOptionalFlag("--verbose", "", "Verbose");
+  args.SetPattern("-H", "[a-z.]+");
+  args.SetPattern("--label", "[a-z]+");
+  bool threw = false;
+  try {
+    args.SetPattern("--verbose", "x");
+  } catch (const SargsError&) {
+    threw = true;
+  }
+  Assert(threw);
+
+  auto run = [&args](const string& host, const string& labels) {
+    Args parsed(args);
+    string str1 = "program";
+    string str2 = "-H=" + host;
+    string str3 = "--label=" + labels;
+    char* argv[3] = { &str1.front(), &str2.front(), &str3.front() };
+    parsed.Initialize(3, argv);
+    return parsed.GetError();
+  };
+  Assert(run("db.local", "tier=gold").empty());
+  Assert(run("DB", "tier=gold") == "Invalid value for --host: DB does not match [a-z.]+");
+  Assert(run("db", "tier=gold,zone=us1") == "Invalid value for --label: us1 does not match [a-z]+");
+
+  stringstream usage;
+  args.PrintUsage(usage);
+  Assert(usage.str().find("Host (pattern: [a-z.]+)") != string::npos);
+  Assert(sargs::LoadSchema(args.Schema()).Schema().find("\"pattern\": \"[a-z]+\"") != string::npos);
+
+  cout << "pass" << endl;
+}
+
+void TestBinaryFlags() {
+  cout << "TestBinaryFlags()...";
+
+  // Long enough for the vectorized blocks, with tails and errors on both sides of them
+  string bytes;
+  for (int i = 0; i < 100; ++i)
+    bytes += static_cast<char>(i * 37 + 11);
+  const string hex_digits = "0123456789abcdef";
+  const string base64_digits = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  for (size_t size = 0; size <= bytes.size(); ++size) {
+    string hex;
+    string base64;
+    for (size_t i = 0; i < size; ++i) {
+      const uint8_t byte = static_cast<uint8_t>(bytes[i]);
+      hex += hex_digits[byte >> 4];
+      hex += (i % 3 == 0) ? static_cast<char>(toupper(hex_digits[byte & 15])) : hex_digits[byte & 15];
+    }
+    for (size_t i = 0; i < size; i += 3) {
+      uint32_t group = static_cast<uint8_t>(bytes[i]) << 16;
+      if (i + 1 < size)
+        group |= static_cast<uint8_t>(bytes[i + 1]) << 8;
+      if (i + 2 < size)
+        group |= static_cast<uint8_t>(bytes[i + 2]);
+      for (size_t j = 0; j < 4; ++j)
+        base64 += (j <= min<size_t>(3, size - i)) ? base64_digits[(group >> (18 - 6 * j)) & 63] : '=';
+    }
+
+    sargs::ByteBuffer decoded;
+    Assert(decoded.Decode(sargs::ArgumentKind::kHex, hex) == string::npos);
+    Assert(string(decoded.Bytes().begin(), decoded.Bytes().end()) == bytes.substr(0, size));
+    Assert(decoded.Decode(sargs::ArgumentKind::kBase64, base64) == string::npos);
+    Assert(string(decoded.Bytes().begin(), decoded.Bytes().end()) == bytes.substr(0, size));
+    const string unpadded = base64.substr(0, base64.find('='));
+    Assert(decoded.Decode(sargs::ArgumentKind::kBase64, unpadded) == string::npos);
+    Assert(decoded.Bytes().size == size);
+
+    if (size > 0) {
+      string bad = hex;
+      bad[hex.size() / 2] = 'g';
+      Assert(decoded.Decode(sargs::ArgumentKind::kHex, bad) == hex.size() / 2);
+      bad = unpadded;
+      bad[unpadded.size() / 2] = '-';
+      Assert(decoded.Decode(sargs::ArgumentKind::kBase64, bad) == unpadded.size() / 2);
+    }
+  }
+
+  Args args;
+  args.DisableExit();
+  args.DisableUsage();
+  args.AddRequiredFlagHex("--key", "-k", "Key");
+  args.AddOptionalFlagBase64("--salt", "", "Salt", "c2FsdA==");
+  Args invalid(args);
+
+  string str1 = "program";
+  string str2 = "-k=0xDEADbeef";
+  char* argv[2] = { &str1.front(), &str2.front() };
+  args.Initialize(2, argv);
+  const sargs::ByteSpan key = args.GetAsBytes("--key");
+  Assert(key.size == 4 && key.data[0] == 0xde && key.data[3] == 0xef);
+  Assert(reinterpret_cast<uintptr_t>(key.data) % alignof(uint64_t) == 0);
+  Assert(string(args.GetAsBytes("--salt").begin(), args.GetAsBytes("--salt").end()) == "salt");
+
+  str2 = "-k=abc";
+  argv[1] = &str2.front();
+  invalid.Initialize(2, argv);
+  Assert(invalid.GetError() == "Invalid hex for --key at offset 2");
+  Assert(sargs::LoadSchema(args.Schema()).Schema().find("\"kind\": \"base64\"") != string::npos);
+
+  cout << "pass" << endl;
+}
+
+// Parses argv with a generated parser and with Args, and checks both give the same values or error.
+// Returns whether the generated parser handled the command line without Args.
+static bool ParseBothWays(vector<string> arguments) {
+  arguments.insert(arguments.begin(), "./server");
+  vector<char*> argv;
+  for (auto& argument : arguments)
+    argv.push_back(&argument[0]);
+
+  TestFlags generated;
+  Args fallback;
+  fallback.DisableExit();
+  fallback.DisableUsage();
+  const string error = generated.Parse(static_cast<int>(argv.size()), argv.data(), fallback);
+
+  TestFlags expected;
+  Args args;
+  args.DisableExit();
+  args.DisableUsage();
+  TestFlags::Register(args);
+  args.Initialize(static_cast<int>(argv.size()), argv.data());
+  string expected_error = args.GetError();
+  if (expected_error.empty())
+    expected_error = expected.Load(args);
+
+  Assert(error == expected_error);
+  if (error.empty()) {
+    Assert(generated.host == expected.host && generated.port == expected.port);
+    Assert(generated.workers == expected.workers && generated.load_factor == expected.load_factor);
+    Assert(generated.verbose == expected.verbose && generated.delete_ == expected.delete_ && generated.q == expected.q);
+    Assert(generated.mode == expected.mode && generated.features == expected.features);
+    Assert(generated.name == expected.name && generated.nonflags == expected.nonflags);
+  }
+  return fallback.GetBinary().empty();
+}
+
+void TestGeneratedParser() {
+  cout << "TestGeneratedParser()...";
+
+  // Command lines the generated parser handles itself
+  Assert(ParseBothWays({ "--host=example.com", "file" }));
+  Assert(ParseBothWays({ "-H", "example.com", "-p", "0x50", "--workers=16", "--load-factor=0.5", "file" }));
+  Assert(ParseBothWays({ "-v", "--delete", "-q", "--mode=safe", "--features=tls,gzip", "--host=a", "--", "-file" }));
+  Assert(ParseBothWays({ "file", "--name", "--host", "--host", "b" }));
+
+  // Everything else goes to Args
+  Assert(!ParseBothWays({ "--host=UPPER", "file" }));
+  Assert(!ParseBothWays({ "--host=a", "--port=http", "file" }));
+  Assert(!ParseBothWays({ "--host=a", "--mode=slow", "file" }));
+  Assert(!ParseBothWays({ "--host=a", "--features=tls,,gzip", "file" }));
+  Assert(!ParseBothWays({ "--host=a", "-vq", "file" }));
+  Assert(!ParseBothWays({ "--host=a", "-H=b", "file" }));
+  Assert(!ParseBothWays({ "--host=a", "--verbose=1", "file" }));
+  Assert(!ParseBothWays({ "--host=a", "--verbos", "file" }));
+  Assert(!ParseBothWays({ "--host=a", "--name=", "file" }));
+  Assert(!ParseBothWays({ "--host=a", "--port" }));
+  Assert(!ParseBothWays({ "--port=1", "file" }));
+  Assert(!ParseBothWays({ "--host=a" }));
+
+  TestFlags flags;
+  Assert(flags.port == 8080 && flags.workers == 4 && flags.load_factor == 0.75f && flags.mode == 1 &&
+         flags.name == "default");
+  Assert(TestFlags::Find("--load-factor", 13) == TestFlags::Find("--load-factor=1", 13));
+  Assert(TestFlags::Find("-p", 2) == TestFlags::Find("--port", 6) && TestFlags::Find("--help", 6) == -1);
+
+  Args args;
+  TestFlags::Register(args);
+  args.DisableExit();
+  args.DisableUsage();
+  string str1 = "./server";
+  char* argv[1] = { &str1.front() };
+  args.Initialize(1, argv);
+  stringstream usage;
+  args.PrintUsage(usage);
+  Assert(usage.str() == TestFlags::Usage());
+
+  cout << "pass" << endl;
+}
+
+void TestSharedMemory() {
+  cout << "TestSharedMemory()...";
+
+  const string name = "/sargs_test_" + to_string(getpid());
+  const auto make_args = [](const int nonflags) {
+    Args args;
+    args.RequireNonFlags(nonflags);
+    args.DisableExit();
+    args.DisableUsage();
+    args.AddRequiredFlagValue("--host", "-H", "Host", "");
+    args.AddOptionalFlagValue("--port", "", "Port", "80");
+    args.AddOptionalFlag("--verbose", "-v", "Verbose");
+    args.AddOptionalFlag("--quiet", "", "Quiet");
+    return args;
+  };
+
+  const auto initialize = [](Args& args, vector<string> arguments) {
+    vector<char*> argv;
+    for (auto& argument : arguments)
+      argv.push_back(&argument.front());
+    args.Initialize(static_cast<int>(argv.size()), argv.data());
+  };
+
+  Args args = make_args(1);
+  Args other = make_args(0);
+  sargs::SharedPublisher publisher(args, name);
+  Args failed(args);
+  initialize(args, { "program", "-H=example.com", "-v", "--", "file" });
+
+  sargs::SharedArgs reader(name);
+  Assert(reader.Sequence() == 2 && reader.Fingerprint() == args.Fingerprint());
+  Assert(reader.GetAsString("--host") == "example.com" && reader.GetAsString("-H") == "example.com");
+  Assert(reader.GetAsUInt64("--port") == 80 && reader.Source("--port") == sargs::ValueSource::kFallback);
+  Assert(reader.Has("--verbose") && reader.Has("-v") && !reader.Has("--quiet") && !reader.Has("--missing"));
+  Assert(reader.Source("-H") == sargs::ValueSource::kCommandLine);
+  Assert(reader.GetNonFlags() == vector<string>{ "file" });
+  bool threw = false;
+  try {
+    reader.GetAsString("--quiet");
+  } catch (const sargs::SargsError&) {
+    threw = true;
+  }
+  Assert(threw);
+
+  // Failed initializations leave the last configuration published
+  initialize(failed, { "program", "--port=8080" });
+  Assert(!failed.GetError().empty() && !reader.Refresh() && reader.Sequence() == 2);
+
+  initialize(other, { "program", "--host=a", "--port=1" });
+  publisher.Publish(other);
+  Assert(reader.GetAsString("-H") == "example.com" && reader.Refresh() && !reader.Refresh());
+  Assert(reader.Sequence() == 4 && reader.GetAsString("-H") == "a" && reader.GetAsInt64("--port") == 1);
+  Assert(!reader.Has("-v") && reader.GetNonFlags().empty());
+
+  // A reader never sees half of an update
+  Args first = make_args(0);
+  initialize(first, { "program", "--host=aaaaaaaa", "--port=8" });
+  Args second = make_args(0);
+  initialize(second, { "program", "--host=b", "--port=1", "-v" });
+  atomic<bool> done(false);
+  thread writer([&]() {
+    for (int i = 0; i < 20000; ++i)
+      publisher.Publish(i % 2 == 0 ? first : second);
+    done = true;
+  });
+  sargs::SharedArgs concurrent(name);
+  while (!done) {
+    concurrent.Refresh();
+    const string host = concurrent.GetAsString("--host");
+    Assert(host.size() == concurrent.GetAsUInt64("--port"));
+    Assert((concurrent.Sequence() & 1) == 0);
+  }
+  writer.join();
+
+  // Only the owner can read the segment, and a running publisher keeps it
+  const int published = shm_open(name.c_str(), O_RDONLY, 0);
+  struct stat status;
+  Assert(published >= 0 && fstat(published, &status) == 0 && (status.st_mode & 0777) == 0600);
+  close(published);
+  threw = false;
+  try {
+    sargs::SharedPublisher duplicate(other, name);
+  } catch (const sargs::SargsError& error) {
+    threw = string(error.what()) == "Shared memory " + name + " is already in use";
+  }
+  Assert(threw);
+
+  // A segment left behind by a publisher that died is replaced
+  const string stale = name + "_stale";
+  const int created = shm_open(stale.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  Assert(created >= 0 && ftruncate(created, sizeof(sargs::SharedHeader)) == 0);
+  void* mapped = mmap(nullptr, sizeof(sargs::SharedHeader), PROT_READ | PROT_WRITE, MAP_SHARED, created, 0);
+  close(created);
+  Assert(mapped != MAP_FAILED);
+  sargs::SharedHeader* header = new (mapped) sargs::SharedHeader();
+  header->magic = sargs::kSharedMagic;
+  header->publisher = static_cast<uint32_t>(getpid());
+  munmap(mapped, sizeof(sargs::SharedHeader));
+  {
+    // Nobody holds its lock, even though the recorded process still runs
+    sargs::SharedPublisher replaced(other, stale, 4096);
+    replaced.Publish(other);
+    Assert(sargs::SharedArgs(stale).Fingerprint() == other.Fingerprint());
+  }
+
+  // A configuration that doesn't fit fails the publish, not the initialization
+  const string small = name + "_small";
+  Args large = make_args(0);
+  sargs::SharedPublisher limited(large, small, sizeof(sargs::SharedHeader) + 64);
+  initialize(large, { "program", "--host=" + string(256, 'h'), "--port=1" });
+  Assert(large.GetError().empty() && limited.GetError().find("does not fit") != string::npos);
+  threw = false;
+  try {
+    limited.Publish(large);
+  } catch (const sargs::SargsError&) {
+    threw = true;
+  }
+  Assert(threw);
+  threw = false;
+  try {
+    sargs::SharedArgs unpublished(small);
+  } catch (const sargs::SargsError& error) {
+    threw = string(error.what()) == "Shared memory " + small + " was not published";
+  }
+  Assert(threw);
+
+  threw = false;
+  try {
+    sargs::SharedPublisher invalid(args, "no_slash");
+  } catch (const sargs::SargsError&) {
+    threw = true;
+  }
+  Assert(threw);
+  threw = false;
+  try {
+    sargs::SharedArgs missing(name + "_missing");
+  } catch (const sargs::SargsError&) {
+    threw = true;
+  }
+  Assert(threw);
+
+  cout << "pass" << endl;
+}
+
 int main(int, char* []) {
 try {
   TestValues();
@@ -307,6 +1716,31 @@ try {
   TestInt16DownconvertLimit();
   TestInt8DownconvertLimit();
   TestBothFlagsAvailable();
+  TestEnumAndSet();
+  TestSweep();
+  TestPinned();
+  TestStaticFlag();
+  TestFingerprint();
+  TestPermissive();
+  TestSharedTokens();
+  TestScope();
+  TestMap();
+  TestInitializeAsync();
+  TestFreeze();
+  TestMemoryUsage();
+  TestRegistry();
+  TestShortOptions();
+  TestCompletion();
+  TestSchema();
+  TestAdmin();
+  TestLimits();
+  TestScopedArgs();
+  TestHelpGroups();
+  TestSuggestions();
+  TestPattern();
+  TestBinaryFlags();
+  TestGeneratedParser();
+  TestSharedMemory();
 } catch (std::exception& ex) {
   cerr << "\nFAIL\n" << endl;
   return 1;
@@ -0,0 +1,544 @@
+#include <sargs.h>
+#include <sargs_schema.h>
+#include <fstream>
+
+using namespace std;
+
+// One flag of the schema, with what the generated code needs to know about it
+struct Flag {
+  string flag;
+  string alias;
+  string name;  // flag, or alias if there is no flag
+  string field;
+  string kind;
+  string type;  // C++ type of the field
+  string fallback;
+  string description;
+  string pattern;
+  bool required = false;
+  bool value = false;
+  vector<sargs::Choice> choices;
+};
+
+[[noreturn]] static void Fail(const string& message) {
+  throw sargs::SargsError(message);
+}
+
+// C++ string literal of text. Anything but printable ASCII is written as a three digit octal escape
+static string Literal(const string& text) {
+  string literal = "\"";
+  for (const char c : text) {
+    const unsigned char byte = static_cast<unsigned char>(c);
+    if (c == '"' || c == '\\') {
+      literal += '\\';
+      literal += c;
+    } else if (c == '\n') {
+      literal += "\\n\"\n      \"";
+    } else if (byte < 0x20 || byte >= 0x7f || c == '?') {
+      const char octal[] = { '\\', static_cast<char>('0' + (byte >> 6)),
+                             static_cast<char>('0' + ((byte >> 3) & 7)),
+                             static_cast<char>('0' + (byte & 7)), '\0' };
+      literal += octal;
+    } else {
+      literal += c;
+    }
+  }
+  return literal + '"';
+}
+
+static string CharLiteral(const char c) {
+  if (c == '\'' || c == '\\')
+    return string("'\\") + c + '\'';
+  if (isprint(static_cast<unsigned char>(c)))
+    return string("'") + c + '\'';
+  return "static_cast<char>(" + to_string(static_cast<unsigned char>(c)) + ")";
+}
+
+// Words a field can't be named, the C++ keywords and the struct's own members
+static bool IsReserved(const string& word) {
+  static const char* keywords[] = {
+    "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case", "catch",
+    "char", "char16_t", "char32_t", "class", "compl", "const", "constexpr", "const_cast", "continue",
+    "decltype", "default", "delete", "do", "double", "dynamic_cast", "else", "enum", "explicit", "export",
+    "extern", "false", "float", "for", "friend", "goto", "if", "inline", "int", "long", "mutable",
+    "namespace", "new", "noexcept", "not", "not_eq", "nullptr", "operator", "or", "or_eq", "private",
+    "protected", "public", "register", "reinterpret_cast", "return", "short", "signed", "sizeof", "static",
+    "static_assert", "static_cast", "struct", "switch", "template", "this", "thread_local", "throw", "true",
+    "try", "typedef", "typeid", "typename", "union", "unsigned", "using", "virtual", "void", "volatile",
+    "wchar_t", "while", "xor", "xor_eq", "nonflags"
+  };
+  for (const char* keyword : keywords) {
+    if (word == keyword)
+      return true;
+  }
+  return false;
+}
+
+// --dry-run becomes dry_run and -v becomes v
+static string FieldName(const string& name) {
+  string field;
+  for (const char c : name.substr(name.find_first_not_of('-'))) {
+    if (isalnum(static_cast<unsigned char>(c)))
+      field += static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    else
+      field += '_';
+  }
+  if (isdigit(static_cast<unsigned char>(field[0])))
+    field = "flag_" + field;
+  return IsReserved(field) ? field + '_' : field;
+}
+
+// Initializer of a field from the flag's fallback, checked here so a bad fallback fails the build
+static string Initializer(const Flag& flag) {
+  if (!flag.value)
+    return "false";
+  if (flag.kind == "enum" || flag.kind == "set") {
+    uint64_t bits = 0;
+    int64_t value = 0;
+    size_t start = 0;
+    while (!flag.fallback.empty() && start <= flag.fallback.size()) {
+      const size_t end =
+        (flag.kind == "set") ? min(flag.fallback.find(',', start), flag.fallback.size()) : flag.fallback.size();
+      const string name = flag.fallback.substr(start, end - start);
+      size_t i = 0;
+      while (i < flag.choices.size() && flag.choices[i].name != name) ++i;
+      if (i == flag.choices.size())
+        Fail("Fallback " + flag.fallback + " of " + flag.name + " is not one of its choices");
+      value = flag.choices[i].value;
+      bits |= 1ULL << value;
+      start = end + 1;
+    }
+    return (flag.kind == "set") ? to_string(bits) + "ULL" : to_string(value) + "LL";
+  }
+  if (flag.type == "std::string")
+    return Literal(flag.fallback);
+  if (flag.fallback.empty())
+    return "0";
+
+  if (flag.type == "int64_t") {
+    int64_t value = 0;
+    if (!sargs::ConvertToInt64(flag.fallback, value))
+      Fail("Fallback " + flag.fallback + " of " + flag.name + " is not an int64");
+    return (value == numeric_limits<int64_t>::min()) ? "INT64_MIN" : to_string(value) + "LL";
+  }
+  if (flag.type == "uint64_t") {
+    uint64_t value = 0;
+    if (!sargs::ConvertToUInt64(flag.fallback, value))
+      Fail("Fallback " + flag.fallback + " of " + flag.name + " is not a uint64");
+    return to_string(value) + "ULL";
+  }
+  float value = 0;
+  if (!sargs::ConvertToFloat(flag.fallback, value))
+    Fail("Fallback " + flag.fallback + " of " + flag.name + " is not a float");
+  stringstream literal;
+  literal.precision(9);
+  literal << showpoint << value << 'f';
+  return literal.str();
+}
+
+static vector<Flag> ReadFlags(const sargs::JsonValue& schema) {
+  vector<Flag> flags;
+  set<string> fields;
+  for (const auto& entry : schema["flags"].items) {
+    Flag flag;
+    flag.flag = entry["flag"].text;
+    flag.alias = entry["alias"].text;
+    flag.name = flag.flag.empty() ? flag.alias : flag.flag;
+    flag.kind = entry["kind"].text;
+    flag.fallback = entry["fallback"].text;
+    flag.description = entry["description"].text;
+    flag.pattern = entry["pattern"].text;
+    flag.required = entry["required"].boolean;
+    flag.value = entry["value"].boolean;
+    for (const auto& choice : entry["choices"].items)
+      flag.choices.emplace_back(choice["name"].text, choice["value"].number);
+
+    for (const string* name : { &flag.flag, &flag.alias }) {
+      if (!name->empty() &&
+          (name->size() < 2 || (*name)[0] != '-' || name->find_first_not_of('-') == string::npos))
+        Fail("Flag " + *name + " must start with - and have a name");
+    }
+    if (flag.kind != "plain" && flag.kind != "enum" && flag.kind != "set")
+      Fail(flag.name + " is a " + flag.kind + " flag. Generated parsers support plain, enum and set flags");
+
+    // The schema may give value flags the type of their field, which is a string otherwise
+    const string type = entry["type"].text;
+    if (!flag.value)
+      flag.type = "bool";
+    else if (flag.kind == "enum")
+      flag.type = "int64_t";
+    else if (flag.kind == "set")
+      flag.type = "uint64_t";
+    else if (type.empty() || type == "string")
+      flag.type = "std::string";
+    else if (type == "int64" || type == "uint64")
+      flag.type = type + "_t";
+    else if (type == "float")
+      flag.type = "float";
+    else
+      Fail("Unknown type " + type + " of " + flag.name + ". Types are string, int64, uint64 and float");
+
+    flag.field = FieldName(flag.name);
+    if (!fields.insert(flag.field).second)
+      Fail("Flags " + flag.name + " and another one both become the field " + flag.field);
+    flags.push_back(flag);
+  }
+  return flags;
+}
+
+// Looks names up by their length and then by one character position that tells all names of that
+// length apart, if there is one. Each lookup ends with one comparison of the whole name.
+static void WriteFind(ostream& output, const vector<Flag>& flags) {
+  map<size_t, vector<pair<string, size_t>>> lengths;
+  for (size_t i = 0; i < flags.size(); ++i) {
+    for (const string* name : { &flags[i].flag, &flags[i].alias }) {
+      if (!name->empty())
+        lengths[name->size()].emplace_back(*name, i);
+    }
+  }
+
+  output << "  // Index of a flag given by its name or alias, or -1. Switches on the length, then on a "
+            "character\n"
+         << "  // that tells apart the names of that length, and compares the name once.\n"
+         << "  static int Find(const char* name, const size_t size) {\n"
+         << "    switch (size) {\n";
+  for (const auto& length : lengths) {
+    const vector<pair<string, size_t>>& names = length.second;
+    output << "      case " << length.first << ":\n";
+    size_t position = length.first;
+    for (size_t p = 0; p < length.first && position == length.first && names.size() > 1; ++p) {
+      set<char> characters;
+      for (const auto& name : names)
+        characters.insert(name.first[p]);
+      if (characters.size() == names.size())
+        position = p;
+    }
+
+    if (position == length.first) {
+      for (const auto& name : names) {
+        output << "        if (std::memcmp(name, " << Literal(name.first) << ", " << length.first << ") == 0)\n"
+               << "          return " << name.second << ";\n";
+      }
+      output << "        return -1;\n";
+      continue;
+    }
+    output << "        switch (name[" << position << "]) {\n";
+    for (const auto& name : names) {
+      output << "          case " << CharLiteral(name.first[position]) << ": return std::memcmp(name, "
+             << Literal(name.first) << ", " << length.first << ") == 0 ? " << name.second << " : -1;\n";
+    }
+    output << "        }\n"
+           << "        return -1;\n";
+  }
+  output << "    }\n"
+         << "    return -1;\n"
+         << "  }\n";
+}
+
+static void WriteConvert(ostream& output) {
+  output << "  static bool Convert(const char* text, std::string& value) {\n"
+         << "    value = text;\n"
+         << "    return true;\n"
+         << "  }\n\n"
+         << "  static bool Convert(const char* text, int64_t& value) {\n"
+         << "    char* end = nullptr;\n"
+         << "    errno = 0;\n"
+         << "    value = std::strtoll(text, &end, 0);\n"
+         << "    return *text != '\\0' && *end == '\\0' && errno != ERANGE;\n"
+         << "  }\n\n"
+         << "  static bool Convert(const char* text, uint64_t& value) {\n"
+         << "    char* end = nullptr;\n"
+         << "    errno = 0;\n"
+         << "    value = std::strtoull(text, &end, 0);\n"
+         << "    return *text != '\\0' && *end == '\\0' && errno != ERANGE;\n"
+         << "  }\n\n"
+         << "  static bool Convert(const char* text, float& value) {\n"
+         << "    char* end = nullptr;\n"
+         << "    errno = 0;\n"
+         << "    value = std::strtof(text, &end);\n"
+         << "    return *text != '\\0' && *end == '\\0' && errno != ERANGE;\n"
+         << "  }\n";
+}
+
+// Matches one choice name of an enum or set flag, from text up to end
+static void WriteChoices(ostream& output, const Flag& flag, const size_t index) {
+  output << "  static bool Choose" << index << "(const char* text, const size_t size, int64_t& value) {\n";
+  for (const auto& choice : flag.choices) {
+    output << "    if (size == " << choice.name.size() << " && std::memcmp(text, " << Literal(choice.name)
+           << ", " << choice.name.size() << ") == 0) {\n"
+           << "      value = " << choice.value << "LL;\n"
+           << "      return true;\n"
+           << "    }\n";
+  }
+  output << "    return false;\n"
+         << "  }\n";
+}
+
+static void WriteParseFast(ostream& output, const vector<Flag>& flags, const int64_t nonflags) {
+  output << "  // Returns false for anything Args must decide: --help, repeated flags, clusters of aliases,\n"
+         << "  // unknown flags and invalid values. Without repeated flags Args never runs out of flags and\n"
+         << "  // takes the rest of the arguments as non-flags, so that case needs no check here.\n"
+         << "  bool ParseFast(int argc, char* argv[]) {\n"
+         << "    bool seen[" << max<size_t>(flags.size(), 1) << "] = {};\n"
+         << "    bool delimiter = false;\n"
+         << "    for (int i = 1; i < argc; ++i) {\n"
+         << "      const char* text = argv[i];\n"
+         << "      if (text[0] == '-' && text[1] == '-' && text[2] == '\\0') {\n"
+         << "        delimiter = true;\n"
+         << "        continue;\n"
+         << "      }\n"
+         << "      if (delimiter || text[0] != '-' || text[1] == '\\0') {\n"
+         << "        nonflags.emplace_back(text);\n"
+         << "        continue;\n"
+         << "      }\n\n"
+         << "      const char* equals = std::strchr(text, '=');\n"
+         << "      const int index = "
+            "Find(text, equals ? static_cast<size_t>(equals - text) : std::strlen(text));\n"
+         << "      if (index < 0 || seen[index])\n"
+         << "        return false;\n"
+         << "      seen[index] = true;\n\n"
+         << "      switch (index) {\n";
+  for (size_t i = 0; i < flags.size(); ++i) {
+    const Flag& flag = flags[i];
+    if (!flag.value) {
+      output << "        case " << i << ":  // " << flag.name << '\n';
+      output << "          if (equals)\n"
+             << "            return false;\n"
+             << "          " << flag.field << " = true;\n"
+             << "          break;\n";
+      continue;
+    }
+
+    output << "        case " << i << ": {  // " << flag.name << '\n'
+           << "          const char* value = equals ? equals + 1 : (i + 1 < argc) ? argv[++i] : \"\";\n"
+           << "          if (*value == '\\0'";
+    if (!flag.pattern.empty()) {
+      output << " || !Pattern" << i << "().Matches(value, std::strlen(value))";
+    }
+    if (flag.kind == "enum") {
+      output << " || !Choose" << i << "(value, std::strlen(value), " << flag.field << "))\n"
+             << "            return false;\n";
+    } else if (flag.kind == "set") {
+      output << ")\n"
+             << "            return false;\n"
+             << "          " << flag.field << " = 0;\n"
+             << "          for (const char* start = value;;) {\n"
+             << "            const char* end = std::strchr(start, ',');\n"
+             << "            const size_t size = end ? static_cast<size_t>(end - start) : std::strlen(start);\n"
+             << "            int64_t choice = 0;\n"
+             << "            if (!Choose" << i << "(start, size, choice))\n"
+             << "              return false;\n"
+             << "            " << flag.field << " |= 1ULL << choice;\n"
+             << "            if (!end)\n"
+             << "              break;\n"
+             << "            start = end + 1;\n"
+             << "          }\n";
+    } else {
+      output << " || !Convert(value, " << flag.field << "))\n"
+             << "            return false;\n";
+    }
+    output << "          break;\n"
+           << "        }\n";
+  }
+  output << "      }\n"
+         << "    }\n\n"
+         << "    if (nonflags.size() != " << nonflags << ")\n"
+         << "      return false;\n";
+  bool any_required = false;
+  for (size_t i = 0; i < flags.size(); ++i) {
+    if (flags[i].required) {
+      output << (any_required ? " ||\n        " : "    if (") << "!seen[" << i << ']';
+      any_required = true;
+    }
+  }
+  if (any_required)
+    output << ")\n      return false;\n";
+  output << "    return true;\n"
+         << "  }\n";
+}
+
+static void WriteRegister(ostream& output, const vector<Flag>& flags, const int64_t nonflags) {
+  output << "  // Registers the flags on args, to parse them with the full parser or along with other flags\n"
+         << "  static void Register(sargs::Args& args) {\n";
+  for (const auto& flag : flags) {
+    const string description = "SARGS_LITERAL(" + Literal(flag.description) + ")";
+    const string names = Literal(flag.flag) + ", " + Literal(flag.alias) + ", " + description;
+    const string requirement = flag.required ? "Required" : "Optional";
+    const string fallback = flag.required ? "" : ", " + Literal(flag.fallback);
+    if (flag.kind == "enum" || flag.kind == "set") {
+      output << "    args.Add" << requirement << "Flag" << (flag.kind == "enum" ? "Enum" : "Set") << '('
+             << names << ", {";
+      for (size_t i = 0; i < flag.choices.size(); ++i) {
+        output << (i == 0 ? "" : ", ");
+        if (flag.kind == "enum")
+          output << "{ " << Literal(flag.choices[i].name) << ", " << flag.choices[i].value << " }";
+        else
+          output << Literal(flag.choices[i].name);
+      }
+      output << '}' << fallback << ");\n";
+    } else if (!flag.value) {
+      output << "    args.Add" << requirement << "Flag(" << names << ");\n";
+    } else {
+      output << "    args.Add" << requirement << "FlagValue(" << names << ", " << Literal(flag.fallback)
+             << ");\n";
+    }
+    if (!flag.pattern.empty())
+      output << "    args.SetPattern(" << Literal(flag.name) << ", " << Literal(flag.pattern) << ");\n";
+  }
+  if (nonflags > 0)
+    output << "    args.RequireNonFlags(" << nonflags << ");\n";
+  output << "  }\n";
+}
+
+static void WriteLoad(ostream& output, const vector<Flag>& flags) {
+  output << "  // Copies the values of an initialized Args. Returns an error for a value that doesn't convert\n"
+         << "  // to the type of its field, or an empty string.\n"
+         << "  std::string Load(const sargs::Args& args) {\n"
+         << "    std::string value;\n";
+  for (const auto& flag : flags) {
+    const string name = Literal(flag.name);
+    if (!flag.value) {
+      output << "    " << flag.field << " = args.Has(" << name << ");\n";
+    } else if (flag.kind == "enum") {
+      output << "    args.GetAsEnum(" << name << ", " << flag.field << ");\n";
+    } else if (flag.kind == "set") {
+      output << "    " << flag.field << " = args.GetAsBitmask(" << name << ");\n";
+    } else {
+      output << "    if (args.GetAsString(" << name << ", value) && !Convert(value.c_str(), " << flag.field
+             << "))\n"
+             << "      return " << Literal("Invalid value for " + flag.name + ": ") << " + value;\n";
+    }
+  }
+  output << "    nonflags = args.GetNonFlags();\n"
+         << "    return \"\";\n"
+         << "  }\n";
+}
+
+static string Usage(const string& json) {
+  sargs::Args args = sargs::LoadSchema(json);
+  const string binary = sargs::JsonReader(json).Read()["binary"].text;
+  string program = binary.empty() ? "program" : binary;
+  char* argv[] = { &program[0] };
+  args.DisableExit();
+  args.DisableUsage();
+  args.Initialize(1, argv);
+  stringstream usage;
+  args.PrintUsage(usage);
+  return usage.str();
+}
+
+static string Generate(const string& json, const string& source, const string& name) {
+  const sargs::JsonValue schema = sargs::JsonReader(json).Read();
+  if (schema.type != sargs::JsonValue::Type::kObject || schema["flags"].type != sargs::JsonValue::Type::kArray)
+    Fail("Invalid schema: expected an object with a flags array");
+  if (schema["flags"].items.empty())
+    Fail("Invalid schema: no flags to generate a parser for");
+  if (!schema["pinned"].items.empty())
+    Fail("Generated parsers don't support pinned flags");
+
+  const vector<Flag> flags = ReadFlags(schema);
+  const int64_t nonflags = schema["nonflags"].number;
+  const string usage = Usage(json);
+
+  stringstream output;
+  output << "// Generated by sargs-generate from " << source << ". Do not edit.\n"
+         << "#pragma once\n\n"
+         << "#include <sargs.h>\n"
+         << "#include <cerrno>\n"
+         << "#include <cstdint>\n"
+         << "#include <cstring>\n\n"
+         << "// Flags of " << source << " as typed fields, with a parser specialized for them\n"
+         << "struct " << name << " {\n";
+  for (const auto& flag : flags) {
+    output << "  " << flag.type << ' ' << flag.field << " = " << Initializer(flag) << ";  // " << flag.name
+           << (flag.required ? ", required" : "") << '\n';
+  }
+  output << "  std::vector<std::string> nonflags;\n\n"
+         << "  // Usage as Args prints it\n"
+         << "  static constexpr const char* Usage() {\n"
+         << "    return " << Literal(usage) << ";\n"
+         << "  }\n\n"
+         << "  // Parses a command line with the specialized parser. Command lines it doesn't handle itself,\n"
+         << "  // which include --help, the hidden sargs arguments and every invalid one, go to args so the\n"
+         << "  // values and errors are exactly those of Args. args must not be initialized yet and gets the\n"
+         << "  // flags registered only then. Returns the error, or an empty string.\n"
+         << "  std::string Parse(int argc, char* argv[], sargs::Args& args) {\n"
+         << "    " << name << " parsed;\n"
+         << "    if (parsed.ParseFast(argc, argv)) {\n"
+         << "      *this = std::move(parsed);\n"
+         << "      return \"\";\n"
+         << "    }\n"
+         << "    Register(args);\n"
+         << "    args.Initialize(argc, argv);\n"
+         << "    if (!args.GetError().empty())\n"
+         << "      return args.GetError();\n"
+         << "    " << name << " loaded;\n"
+         << "    const std::string error = loaded.Load(args);\n"
+         << "    if (error.empty())\n"
+         << "      *this = std::move(loaded);\n"
+         << "    return error;\n"
+         << "  }\n\n"
+         << "  // Like SARGS_INITIALIZE(), prints usage and exits on errors of the command line\n"
+         << "  std::string Parse(int argc, char* argv[]) {\n"
+         << "    sargs::Args args;\n"
+         << "    return this->Parse(argc, argv, args);\n"
+         << "  }\n\n";
+  WriteRegister(output, flags, nonflags);
+  output << '\n';
+  WriteLoad(output, flags);
+  output << '\n';
+  WriteFind(output, flags);
+  output << "\n private:\n";
+  WriteConvert(output);
+  for (size_t i = 0; i < flags.size(); ++i) {
+    if (flags[i].kind == "enum" || flags[i].kind == "set") {
+      output << '\n';
+      WriteChoices(output, flags[i], i);
+    }
+    if (!flags[i].pattern.empty()) {
+      output << "\n  static const sargs::Pattern& Pattern" << i << "() {\n"
+             << "    static const sargs::Pattern pattern(" << Literal(flags[i].pattern) << ");\n"
+             << "    return pattern;\n"
+             << "  }\n";
+    }
+  }
+  output << '\n';
+  WriteParseFast(output, flags, nonflags);
+  output << "};\n";
+  return output.str();
+}
+
+int main(int argc, char* argv[]) {
+  SARGS_REQUIRED_FLAG_VALUE("--schema", "-s", "JSON schema of the flags, as written by --sargs-dump-schema");
+  SARGS_REQUIRED_FLAG_VALUE("--output", "-o", "Header to write");
+  SARGS_OPTIONAL_FLAG_VALUE_DEFAULT("--name", "-n", "Name of the generated struct", "Flags");
+  SARGS_INITIALIZE(argc, argv);
+
+  const string path = SARGS_GET_STRING("--schema");
+  ifstream input(path);
+  if (!input) {
+    cerr << "Could not read " << path << endl;
+    return 2;
+  }
+  const string json((istreambuf_iterator<char>(input)), istreambuf_iterator<char>());
+
+  string header;
+  try {
+    header = Generate(json, path.substr(path.find_last_of("/\\") + 1), SARGS_GET_STRING("--name"));
+  } catch (const exception& ex) {
+    cerr << path << ": " << ex.what() << endl;
+    return 1;
+  }
+
+  // Leave an unchanged header alone so its dependents aren't rebuilt
+  ifstream existing(SARGS_GET_STRING("--output"));
+  if (existing && string((istreambuf_iterator<char>(existing)), istreambuf_iterator<char>()) == header)
+    return 0;
+  ofstream output(SARGS_GET_STRING("--output"));
+  output << header;
+  if (!output) {
+    cerr << "Could not write " << SARGS_GET_STRING("--output") << endl;
+    return 2;
+  }
+  return 0;
+}
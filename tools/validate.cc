@@ -0,0 +1,108 @@
+#include <sargs.h>
+#include <sargs_schema.h>
+#include <fstream>
+#include <thread>
+
+using namespace std;
+
+// Reads one argument per line. The program name is not part of the file.
+static bool ReadArguments(const string& path, vector<string>& arguments) {
+  ifstream input(path);
+  if (!input)
+    return false;
+  string line;
+  while (getline(input, line)) {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    arguments.push_back(line);
+  }
+  return true;
+}
+
+static string Validate(const sargs::Args& schema, const string& path) {
+  vector<string> arguments = { schema.GetBinary() };
+  if (!ReadArguments(path, arguments))
+    return "Could not read " + path;
+
+  vector<char*> argv;
+  for (auto& argument : arguments)
+    argv.push_back(&argument[0]);
+
+  sargs::Args args(schema);
+  args.DisableExit();
+  args.DisableUsage();
+  try {
+    args.Initialize(static_cast<int>(argv.size()), argv.data());
+  } catch (const exception& ex) {
+    return ex.what();
+  }
+  return args.GetError();
+}
+
+int main(int argc, char* argv[]) {
+  SARGS_REQUIRED_FLAG_VALUE("--schema", "-s", "JSON schema written by the program's --sargs-dump-schema");
+  SARGS_REQUIRED_FLAG_VALUE("--list", "-l", "File naming one command line file per line, or - for stdin");
+  SARGS_OPTIONAL_FLAG_VALUE_DEFAULT("--jobs", "-j", "Number of threads, or 0 for one per core", "0");
+  SARGS_OPTIONAL_FLAG("--verbose", "-v", "Also print the files that are valid");
+  SARGS_INITIALIZE(argc, argv);
+
+  ifstream schema_input(SARGS_GET_STRING("--schema"));
+  if (!schema_input) {
+    cerr << "Could not read " << SARGS_GET_STRING("--schema") << endl;
+    return 2;
+  }
+  const string json((istreambuf_iterator<char>(schema_input)), istreambuf_iterator<char>());
+
+  vector<string> paths;
+  const string list = SARGS_GET_STRING("--list");
+  ifstream list_file;
+  if (list != "-")
+    list_file.open(list);
+  istream& list_input = (list == "-") ? cin : list_file;
+  if (!list_input) {
+    cerr << "Could not read " << list << endl;
+    return 2;
+  }
+  string path;
+  while (getline(list_input, path)) {
+    if (!path.empty())
+      paths.push_back(path);
+  }
+
+  sargs::Args schema;
+  try {
+    schema = sargs::LoadSchema(json);
+  } catch (const exception& ex) {
+    cerr << ex.what() << endl;
+    return 2;
+  }
+
+  size_t jobs = SARGS_GET_UINT64("--jobs");
+  if (jobs == 0)
+    jobs = max(1u, thread::hardware_concurrency());
+  jobs = min(jobs, max<size_t>(paths.size(), 1));
+
+  vector<string> errors(paths.size());
+  atomic<size_t> next(0);
+  vector<thread> workers;
+  for (size_t i = 0; i < jobs; ++i) {
+    workers.emplace_back([&]() {
+      for (size_t index = next++; index < paths.size(); index = next++)
+        errors[index] = Validate(schema, paths[index]);
+    });
+  }
+  for (auto& worker : workers)
+    worker.join();
+
+  size_t failed = 0;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (!errors[i].empty()) {
+      cout << paths[i] << ": " << errors[i] << "\n";
+      ++failed;
+    } else if (SARGS_HAS("--verbose")) {
+      cout << paths[i] << ": ok\n";
+    }
+  }
+  cout << failed << " of " << paths.size() << " command lines failed validation" << endl;
+  return failed == 0 ? 0 : 1;
+}